@@ -0,0 +1,48 @@
+#include "init_shapes.h"
+#include <stdbool.h>
+
+#ifndef AABBTREE_H
+#define AABBTREE_H
+
+// How far a leaf's box reaches past the body's bounds on every side; a fifth
+// of the demo's ellipse radius
+#define AABB_TREE_MARGIN 0.005f
+
+typedef struct
+{
+    AABB box;   // fat box for leaves, union of the children otherwise
+    Body *body; // leaves only
+    int parent; // next free node while on the free list
+    int child1; // -1 for leaves
+    int child2;
+    int height; // 0 for leaves, -1 for free nodes
+} AABBTreeNode;
+
+// Incrementally updated bounding volume hierarchy. Leaves hold enlarged
+// boxes, so a body only has to be reinserted once it leaves its box, and
+// the tree is kept balanced with AVL style rotations.
+typedef struct
+{
+    AABBTreeNode *nodes;
+    int root;
+    int capacity;
+    int freeList;
+    int proxyCount;
+} AABBTree;
+
+// Returns the proxy (leaf node index) for the body
+int aabbtree_create_proxy(AABBTree *tree, AABB bounds, Body *body);
+void aabbtree_destroy_proxy(AABBTree *tree, int proxy);
+
+// Refits the proxy to new bounds; `displacement` is how far the body is
+// expected to move next and stretches the fat box that way. Returns true
+// when the leaf had to be reinserted.
+bool aabbtree_move_proxy(AABBTree *tree, int proxy, AABB bounds, Vec2 displacement);
+
+// Bodies whose fat box overlaps `box`; bounded like the kd-tree queries
+int aabbtree_query(AABBTree *tree, AABB box, Body **out, int maxCount, bool *truncated);
+
+int aabbtree_height(AABBTree *tree);
+void aabbtree_free(AABBTree *tree);
+
+#endif
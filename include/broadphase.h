@@ -0,0 +1,37 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include "init_shapes.h"
+#include <stdbool.h>
+
+typedef struct
+{
+    Body *a;
+    Body *b;
+} BodyPair;
+
+typedef struct
+{
+    BodyPair *pairs;
+    int count;
+    int capacity;
+} PairList;
+
+void pairlist_push(PairList *list, Body *a, Body *b);
+void pairlist_free(PairList *list);
+
+void pairlist_append(PairList *list, PairList *other);
+
+// A spatial structure's bounded box query, as kd_query_aabb() and
+// aabbtree_query(). It may return bodies whose bounds only come close.
+typedef int (*BroadphaseQuery)(void *structure, AABB box, Body **out, int maxCount, bool *truncated);
+
+// Fills `pairs` with every pair of bodies whose bounds overlap, using
+// `query` on `structure` to find candidates. `bounds` holds the AABB of
+// each body, indexed like bodyAt(). Pairs without an awake body are
+// skipped, and each pair is ordered so that `a` has the lower index.
+// Queries run as parallel jobs; the output order does not depend on the
+// thread count.
+void broadphase_collect(BroadphaseQuery query, void *structure, AABB *bounds, PairList *pairs);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef CIRCLEBATCH_H
+#define CIRCLEBATCH_H
+
+#include "collision.h"
+
+// Circle pairs gathered for one batched test, one array per field so a
+// SIMD kernel loads several pairs at once. The arrays are padded with
+// empty pairs up to a multiple of the widest kernel.
+typedef struct
+{
+    float *ax; // A's center, radius and rotation
+    float *ay;
+    float *radiusA;
+    float *cosA;
+    float *sinA;
+    float *bx; // ... and B's
+    float *by;
+    float *radiusB;
+    float *cosB;
+    float *sinB;
+    unsigned char *filled; // 1 when A is filled, 2 when B is
+    int *pair;             // whatever the caller tells the pairs apart by
+
+    // Filled in by circlebatch_run(), the same as collideCircles() would.
+    // A filled circle holding the other's center is no hit, as for
+    // isInsideShape() in the world.
+    float *normalX;
+    float *normalY;
+    float *depth;
+    unsigned char *hit;
+
+    int count;
+    int capacity;
+} CircleBatch;
+
+// Picks the kernel for every batch: `lanes` pairs at a time, 0 for the
+// widest the CPU runs (8 with AVX2, 4 with SSE2 or NEON), 1 for scalar.
+// Falls back to the widest available one below an unsupported width.
+// Returns the lanes picked. Call before any batch runs.
+int circlebatch_select(int lanes);
+
+int circlebatch_lanes(void);
+
+void circlebatch_clear(CircleBatch *batch);
+
+// A and B have to be circles, collisionIsCircles() in narrowphase.h
+void circlebatch_push(CircleBatch *batch, Body *a, Body *b, int pair);
+
+void circlebatch_run(CircleBatch *batch);
+
+// The contact of pair k, which has to be a hit
+void circlebatch_result(CircleBatch *batch, int k, CollisionResult *result);
+
+void circlebatch_free(CircleBatch *batch);
+
+#endif
@@ -2,26 +2,101 @@
 #define COLLISION_H
 
 #include "init_shapes.h"
-#include "draw_shapes.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <vectors.h>
 
+#define MAX_MANIFOLD_POINTS 2
+
 typedef struct
 {
-    bool hit;
-    Vec2 normal;
+    Vec2 point; // world space, halfway between the two surfaces
     float depth;
+    uint32_t id; // the features that made the point, the same while they keep touching
+} ContactPoint;
+
+typedef struct
+{
+    bool hit;
+    Vec2 normal; // unit vector pointing from A towards B
+    float depth; // how far B reaches into A along the normal
+    ContactPoint points[MAX_MANIFOLD_POINTS];
+    int pointCount;
 } CollisionResult;
 
+typedef struct
+{
+    Vec2 point;     // support of A minus support of B
+    Vec2 direction; // the support was taken along
+} SimplexVertex;
+
+// What GJK leaves for the same pair to start from on the next step, in
+// the pair's A towards B order. Zeroed, it starts cold.
+typedef struct
+{
+    Vec2 direction;            // last search direction, the separating axis when they were apart
+    Vec2 supportDirections[3]; // of the simplex that contained the origin
+    int count;                 // 3 when they overlapped, else 0
+    float separation;          // they were at least this far apart, 0 when they overlapped
+} GJKCache;
+
+typedef struct
+{
+    float distance;   // between the closest points, 0 when the shapes overlap
+    float lowerBound; // the shapes are at least this far apart for certain
+    Vec2 pointA;      // closest points, world space
+    Vec2 pointB;
+    Vec2 normal; // unit, from pointA towards pointB; zero when they overlap
+    int iterations;
+} DistanceResult;
+
+typedef struct
+{
+    bool hit;
+    float t;     // fraction of the motion done when they come within the target distance, 1 without a hit
+    Vec2 normal; // unit, from A towards B at that time
+    Vec2 point;  // closest point on B at that time
+    int iterations;
+} TOIResult;
+
 // void createMinkowskiDifference(Body *out, Body *A, Body *B);
-bool checkGJK(Body *A, Body *B, Vec2 simplexOut[3], int *simplexCountOut);
-bool checkCollision(Body *A, Body *B, CollisionResult *result);
-Vec2 support(Body *body, Vec2 direction);
-bool handleSimplex(Vec2 *simplex, int *count, Vec2 *dir);
-bool handleTriangle(Vec2 *simplex, int *count, Vec2 *dir);
-bool handleLine(Vec2 *simplex, int *count, Vec2 *dir);
+// `cache` may be NULL
+bool checkGJK(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, Vec2 simplexOut[3], int *simplexCountOut);
+bool checkCollisionGJK(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result);
+
+// Closest points of two convex shapes by GJK. Returns whether they are apart.
+bool checkDistanceGJK(Body *A, Transform xfA, Body *B, Transform xfB, DistanceResult *out);
+
+// Same for two bodies where they are now, concave polygons included
+bool bodyDistance(Body *A, Body *B, DistanceResult *out);
+
+// When A, moving by `translation` while B holds still, first comes within
+// `target` of B. Shapes that already overlap, or don't close in, don't hit.
+bool checkTimeOfImpact(Body *A, Transform xfA, Vec2 translation, Body *B, Transform xfB, float target, TOIResult *out);
+
+// Same for two bodies from where they are now, the earliest over their parts
+bool bodyTimeOfImpact(Body *A, Vec2 translation, Body *B, float target, TOIResult *out);
+Vec2 support(Body *body, Transform xf, Vec2 direction);
+bool handleSimplex(SimplexVertex *simplex, int *count, Vec2 *dir);
+bool handleTriangle(SimplexVertex *simplex, int *count, Vec2 *dir);
+bool handleLine(SimplexVertex *simplex, int *count, Vec2 *dir);
 bool polygonIsConvex(Vec2 *p, int n);
-CollisionResult calculateEPA(Body *A, Body *B, Vec2 simplex[3], int simplexCount);
+void updateConvexParts(Body *body);
+Body *convexParts(Body *body, int *count);
+Transform partTransform(Body *body, Transform xf, int part);
+CollisionResult calculateEPA(Body *A, Transform xfA, Body *B, Transform xfB, Vec2 simplex[3], int simplexCount);
+
+// Totals over every calculateEPA() call since the last reset, from any thread
+typedef struct
+{
+    int runs;
+    int iterations;
+    int maxIterations; // of a single run
+    int truncated;     // runs that hit the iteration limit and kept their closest edge
+} EPAStats;
+
+EPAStats getEPAStats(void);
+void resetEPAStats(void);
 
 #endif
\ No newline at end of file
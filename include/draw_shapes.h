@@ -4,12 +4,16 @@
 #include "init_shapes.h"
 #include <glad/glad.h>
 
-void initDraw(GLuint vao, GLuint vbo, GLint colorLoc);
-void setColor(Color color);
+// The draw functions only queue geometry; nothing reaches the GPU until
+// flushDraw(), which renders the whole frame with one upload per buffer.
+// shapeProgram draws plain colored vertices, ellipseProgram expands
+// instances of the unit circle (see the shaders in main.c).
+void initDraw(GLuint vao, GLuint vbo, GLuint shapeProgram, GLuint ellipseProgram);
 void drawPolygon(Body *body);
 void drawLine(Body *body);
 void drawEllipse(Body *body);
 void drawAllShapes();
 void draw(Body *body);
+void flushDraw(void);
 
 #endif
\ No newline at end of file
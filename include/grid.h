@@ -0,0 +1,46 @@
+#include "init_shapes.h"
+#include <stdbool.h>
+
+#ifndef GRID_H
+#define GRID_H
+
+// Uniform grid of square cells over the whole plane, hashed into a fixed
+// number of buckets and rebuilt every step with a counting sort. Each body
+// sits in the one cell holding the center of its bounds, so with cells at
+// least as wide as the bodies a query only scans the cells next to its box.
+// Bodies larger than a cell are kept aside and checked against every
+// query. All storage is flat arrays kept between builds.
+typedef struct
+{
+    AABB *bounds; // from the last build, indexed like bodyAt()
+    float cellSize;
+    int bucketCount; // power of two
+
+    // Bucket b holds slots [bucketStart[b], bucketStart[b + 1]); a slot is
+    // a body and its cell, since different cells can share a bucket
+    int *bucketStart;
+    int *slotBody;
+    int *slotX;
+    int *slotY;
+    int slotCount;
+
+    int *large; // bodies too big for a cell
+    int largeCount;
+
+    int *bodyBucket; // build scratch, indexed like bodyAt()
+    int *bodyX;
+    int *bodyY;
+
+    int bucketCapacity;
+    int bodyCapacity;
+} SpatialGrid;
+
+// Grid over the first `count` bodies. A cellSize <= 0 uses the largest
+// dynamic body, which suits scenes of equal-sized particles.
+void grid_build(SpatialGrid *grid, int count, AABB *bounds, float cellSize);
+void grid_free(SpatialGrid *grid);
+
+// Bodies whose bounds overlap `box`, bounded like the kd-tree queries
+int grid_query(SpatialGrid *grid, AABB box, Body **out, int maxCount, bool *truncated);
+
+#endif
@@ -4,8 +4,6 @@
 #include <stdbool.h>
 #include "vectors.h"
 
-#define MAX_SHAPES 1000
-
 #define COLOR_RED (Color){1.0f, 0.0f, 0.0f, 1.0f}
 #define COLOR_GREEN (Color){0.0f, 1.0f, 0.0f, 1.0f}
 #define COLOR_BLUE (Color){0.0f, 0.0f, 1.0f, 1.0f}
@@ -50,46 +48,94 @@ typedef enum
     SHAPE_ELLIPSE
 } ShapeType;
 
-typedef struct
+// Per-body state the step streams over lives in bodyState below; a Body
+// holds what is only touched per pair or per draw: shape, material, render
+typedef struct Body
 {
-    int id;
+    int id;    // unique for the run, never reused after removeBody()
+    int index; // slot in bodyAt() and bodyState, -1 for convex parts
     ShapeType type;
 
-    Vec2 acceleration;
-    Vec2 velocity;
-
     float mass;
     float restitution;
     float friction;
 
     bool filled;
-    bool isDynamic;
-
     Color color;
 
     union
     {
         struct
         {
-            Vec2 vertices[2];
-            Vec2 center;
+            Vec2 vertices[2]; // local space
         } line;
         struct
         {
-            Vec2 *vertices;
+            Vec2 *vertices; // local space, centered on the vertex average
+            Vec2 *normals;  // outward normal of the edge from vertex i to i + 1
             int numVertices;
-            Vec2 center;
+
+            // Convex decomposition cache, built on first use by updateConvexParts()
+            bool decomposed;
+            bool convex;
+            struct Body *parts;
+            Vec2 *partOffsets; // part centers in this polygon's local frame
+            int partCount;
+
+            // Large convex polygons only, for support() to binary search:
+            // how far each edge normal is turned past the first one in the
+            // winding direction, which grows with the edge index
+            float *normalAngles;
+            float firstNormalAngle;
+            float winding; // 1 counterclockwise, -1 clockwise
         } polygon;
         struct
         {
-            Vec2 pos;
             Vec2 r;
-            float rotation;
         } ellipse;
     } data;
 } Body;
 
-extern Body bodies[MAX_SHAPES];
+#define BODY_DYNAMIC 0x01
+#define BODY_SLEEPING 0x02
+#define BODY_BOUNDED 0x04 // bounces off the world bounds
+#define BODY_MOVED 0x08   // moved outside the step, the broadphase has to refit it
+#define BODY_BULLET 0x10  // swept by time of impact so it can't pass through thin bodies
+
+#define BODY_AWAKE(flags) (((flags) & (BODY_DYNAMIC | BODY_SLEEPING)) == BODY_DYNAMIC)
+
+// Hot simulation state, one array per field, indexed like bodyAt(). The
+// arrays are 64 byte aligned so loops over a range of bodies only pull in
+// the fields they use.
+typedef struct
+{
+    float *positionX;
+    float *positionY;
+    float *rotation;
+    float *cosRotation;
+    float *sinRotation;
+    float *velocityX;
+    float *velocityY;
+    float *inverseMass;
+    float *sleepTime; // how long the body has been moving slower than the sleep threshold
+    int *proxy; // broadphase handle owned by the world, -1 until it has one
+    unsigned char *flags;
+} BodyState;
+
+extern BodyState bodyState;
+
+// Bodies live in fixed size pages that never move, so a Body pointer stays
+// valid however many bodies are added later. removeBody() still moves the
+// last body into the freed slot.
+#define BODY_PAGE_BITS 10
+#define BODY_PAGE_SIZE (1 << BODY_PAGE_BITS)
+
+extern Body **bodyPages;
+
+static inline Body *bodyAt(int index)
+{
+    return &bodyPages[index >> BODY_PAGE_BITS][index & (BODY_PAGE_SIZE - 1)];
+}
 
 Body *init_line(Vec2 a, Vec2 b, Color color);
 
@@ -99,9 +145,51 @@ Body *init_ellipse(Vec2 pos, Vec2 r, Color color);
 
 Vec2 findCenter(Body *body);
 
+AABB findBounds(Body *body);
+
+Transform getTransform(Body *body);
+
+Vec2 getPosition(Body *body);
+
+void setPosition(Body *body, Vec2 position);
+
+float getRotation(Body *body);
+
+void setRotation(Body *body, float rotation);
+
+Vec2 getVelocity(Body *body);
+
+void setVelocity(Body *body, Vec2 velocity);
+
+void setMass(Body *body, float mass);
+
+void setDynamic(Body *body, bool dynamic);
+
+bool isDynamic(Body *body);
+
+// Opt-in continuous collision for small fast bodies, at the cost of a
+// sweep against everything in their path every step
+void setBullet(Body *body, bool bullet);
+
+bool isBullet(Body *body);
+
+bool isSleeping(Body *body);
+
+bool isAwake(Body *body);
+
+Vec2 toWorld(Body *body, Vec2 local);
+
+Vec2 toLocal(Body *body, Vec2 world);
+
+Vec2 worldVertex(Body *body, int index);
+
 bool removeBody(Body *body);
 
-void decompose(Body *body, Body **triangles, int *triangle_count);
+void computeEdgeNormals(Vec2 *vertices, int numVertices, Vec2 *normals);
+
+void decompose(Body *body, int *triangles, int *triangle_count);
+
+void invalidateDecomposition(Body *body);
 
 bool isInsideShape(Body *a, Body *b);
 
@@ -0,0 +1,23 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+// Runs fn over [begin, end); `thread` is the index of the worker running it,
+// in [0, jobs_thread_count()), for picking per-thread scratch memory
+typedef void (*JobRangeFn)(void *context, int begin, int end, int thread);
+
+// threadCount <= 0 uses one thread per online CPU. The calling thread
+// counts as worker 0 and takes part in every jobs_parallel_for().
+void jobs_init(int threadCount);
+void jobs_shutdown(void);
+int jobs_thread_count(void);
+
+// Splits [0, count) into chunks of `grain` items, spreads them over the
+// worker queues and returns once all of them ran. Idle workers steal chunks
+// from busy ones. Chunk k always covers [k * grain, (k + 1) * grain), so
+// results written per chunk can be merged in a deterministic order.
+// Must not be called from inside a job.
+void jobs_parallel_for(int count, int grain, JobRangeFn fn, void *context);
+
+int jobs_chunk_count(int count, int grain);
+
+#endif
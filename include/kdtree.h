@@ -1,19 +1,50 @@
 #include "init_shapes.h"
+#include <stdbool.h>
 #include <stdlib.h>
 
 #ifndef KDTREE_H
 #define KDTREE_H
 
-typedef struct KDNode
+typedef struct
 {
     Vec2 pos;
     Body *body;
-    struct KDNode *left;
-    struct KDNode *right;
+    AABB bounds;  // bounds of this node's body
+    AABB subtree; // union of bounds of this node and all its children
+    int axis;     // 0 splits on x, 1 on y
+    int left;     // node indices, -1 when there is no child
+    int right;
 } KDNode;
 
-KDNode *kd_insert(KDNode *node, Vec2 pos, Body *body, int depth);
-void kd_search_range(KDNode *node, Vec2 point, float radius, int depth, Body **out, int *count);
-void kd_free(KDNode *node);
+// Nodes live in one array in depth-first order with the root at 0. The
+// arrays are kept between builds, so rebuilding every step allocates only
+// when the body count grows.
+typedef struct
+{
+    KDNode *nodes;
+    int *order; // build scratch: body indices being partitioned
+    int count;
+    int capacity;
+} KDTree;
+
+// Balanced tree over the first `count` bodies, split at the median position
+// along the wider axis of each subset. `bounds` is indexed like bodyAt().
+void kd_build(KDTree *tree, int count, AABB *bounds);
+void kd_free(KDTree *tree);
+
+// Queries walk the tree with a fixed explicit stack, which a balanced tree
+// never outgrows, and are safe to run from several threads at once. They
+// match against each body's bounds, so large shapes are found even when
+// their center is far from the query.
+//
+// The range queries write at most maxCount bodies to `out` and return how
+// many they wrote; *truncated (may be NULL) tells whether more matched.
+int kd_query_aabb(KDTree *tree, AABB box, Body **out, int maxCount, bool *truncated);
+int kd_query_radius(KDTree *tree, Vec2 point, float radius, Body **out, int maxCount, bool *truncated);
+
+// The k bodies whose bounds are closest to `point`, nearest first, with
+// their distances (0 when the point is inside the bounds). Returns how many
+// were found, which is only less than k when the tree holds fewer bodies.
+int kd_query_nearest(KDTree *tree, Vec2 point, int k, Body **out, float *distances);
 
-#endif
\ No newline at end of file
+#endif
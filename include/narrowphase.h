@@ -0,0 +1,28 @@
+#ifndef NARROWPHASE_H
+#define NARROWPHASE_H
+
+#include "collision.h"
+
+typedef bool (*NarrowphaseFn)(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result);
+
+// Closed-form tests; each one expects its bodies in the order of its name,
+// each placed at the transform passed after it. Polygons must be convex
+// (pass the parts from convexParts() with their partTransform()).
+bool collideCircles(Body *A, Transform xfA, Body *B, Transform xfB, CollisionResult *result);
+bool collideCirclePolygon(Body *A, Transform xfA, Body *B, Transform xfB, CollisionResult *result);
+bool collideCircleLine(Body *A, Transform xfA, Body *B, Transform xfB, CollisionResult *result);
+bool collidePolygons(Body *A, Transform xfA, Body *B, Transform xfB, CollisionResult *result);
+
+// Picks the routine for the pair's shape types, falling back to GJK + EPA
+// for ellipses that are not circles and for line-line pairs. GJK starts
+// from and updates `cache` when it is not NULL.
+bool checkCollision(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result);
+
+// Whether checkCollision() would take the GJK + EPA path for the pair
+bool collisionUsesGJK(Body *A, Body *B);
+
+// Whether it would take the circle-circle kernel, which circlebatch.h runs
+// on many pairs at once
+bool collisionIsCircles(Body *A, Body *B);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef PAIRCACHE_H
+#define PAIRCACHE_H
+
+#include "collision.h"
+#include "pairmap.h"
+
+// What the step learned about a pair of bodies, kept for as long as the
+// broadphase keeps reporting the pair (or both bodies are at rest)
+typedef struct
+{
+    int idA; // Body ids, the handles the cache is keyed by
+    int idB;
+    Body *a; // as of the last step the pair was reported, in its order
+    Body *b;
+    int stamp; // that step
+
+    bool touching;    // the narrowphase found contact on the last step
+    bool wasTouching; // ... and on the step before
+
+    GJKCache gjk; // for the next step to start from, when GJK ran on the pair
+
+    // The pair was at least `separation` apart when the bodies sat at these
+    // poses, 0 when not known to be apart
+    float separation;
+    Vec2 positionA;
+    Vec2 positionB;
+    float rotationA;
+    float rotationB;
+
+    CollisionResult manifold; // normal, depth and contact points of the last step
+    float normalImpulse;      // impulse the response applied along the normal on the last step
+} PairCacheEntry;
+
+typedef enum
+{
+    PAIR_BEGIN,   // started touching
+    PAIR_PERSIST, // still touching
+    PAIR_END      // stopped touching, moved apart or one of the bodies was removed
+} PairEventType;
+
+typedef struct
+{
+    PairEventType type;
+    int idA;
+    int idB;
+    Body *a; // NULL once the body has been removed
+    Body *b;
+} PairEvent;
+
+// Entries live in one array, found by body ids through an open addressing
+// map. Entry indices are stable from paircache_touch() until the next
+// paircache_update().
+typedef struct
+{
+    PairCacheEntry *entries;
+    int count;
+    int capacity;
+    PairMap index;
+
+    PairEvent *events; // from the last paircache_update()
+    int eventCount;
+    int eventCapacity;
+} PairCache;
+
+// The entry for a pair the broadphase reported on step `stamp`, created if
+// it is new. Clears the per-step results.
+int paircache_touch(PairCache *cache, Body *a, Body *b, int stamp);
+
+// removeBody() moves the last body into the slot it frees; points the
+// entries of the `moved` bodies at their new slots, so that only removed
+// bodies count as gone
+void paircache_follow(PairCache *cache, Body **moved, int count);
+
+PairCacheEntry *paircache_find(PairCache *cache, Body *a, Body *b);
+
+// Turns the step's narrowphase results into events and drops the entries
+// the broadphase stopped reporting, unless both bodies are resting
+void paircache_update(PairCache *cache, int stamp);
+
+void paircache_free(PairCache *cache);
+
+#endif
@@ -0,0 +1,39 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef PAIRMAP_H
+#define PAIRMAP_H
+
+// Marks a free slot; no key built by pairmap_key() has all bits set
+#define PAIRMAP_EMPTY UINT64_MAX
+
+// Open addressing hash map from an unordered pair of handles to an int,
+// with linear probing and no tombstones: removals shift the following
+// entries back instead
+typedef struct
+{
+    uint64_t *keys;
+    int *values;
+    int capacity; // power of two
+    int count;
+} PairMap;
+
+// Same key for (a, b) and (b, a); handles must not be negative
+static inline uint64_t pairmap_key(int a, int b)
+{
+    return a < b ? (uint64_t)a << 32 | (uint32_t)b : (uint64_t)b << 32 | (uint32_t)a;
+}
+
+// The value stored for `key`, or -1
+int pairmap_get(PairMap *map, uint64_t key);
+
+// Inserts or overwrites
+void pairmap_put(PairMap *map, uint64_t key, int value);
+
+// Returns false when the key was not there
+bool pairmap_remove(PairMap *map, uint64_t key);
+
+void pairmap_clear(PairMap *map);
+void pairmap_free(PairMap *map);
+
+#endif
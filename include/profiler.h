@@ -0,0 +1,47 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+
+// Number of frames the rolling statistics cover
+#define PROFILER_WINDOW 120
+
+typedef enum
+{
+    PROFILE_PREPARE,
+    PROFILE_BROADPHASE_UPDATE, // keeping the broadphase structure current
+    PROFILE_BROADPHASE,
+    PROFILE_NARROWPHASE,
+    PROFILE_RESPONSE,
+    PROFILE_INTEGRATE,
+    PROFILE_SLEEP,
+    PROFILE_DRAW,
+    PROFILE_SWAP,
+    PROFILE_FRAME, // time between two profiler_frame_end() calls
+    PROFILE_PHASE_COUNT
+} ProfilePhase;
+
+typedef struct
+{
+    float min; // milliseconds
+    float avg;
+    float p99;
+} ProfileStats;
+
+// A phase may be timed several times per frame; the times add up
+void profiler_begin(ProfilePhase phase);
+void profiler_end(ProfilePhase phase);
+
+// Closes the current frame and pushes its times into the rolling window
+void profiler_frame_end(void);
+
+// Statistics over the frames currently in the window
+ProfileStats profiler_stats(ProfilePhase phase);
+int profiler_frame_count(void);
+
+const char *profiler_phase_name(ProfilePhase phase);
+
+// One line per phase that was timed at least once
+void profiler_print(FILE *out);
+
+#endif
@@ -0,0 +1,79 @@
+#include "init_shapes.h"
+#include "broadphase.h"
+#include "pairmap.h"
+#include <stdbool.h>
+
+#ifndef SAP_H
+#define SAP_H
+
+typedef struct
+{
+    float value;
+    int data; // proxy * 2, plus 1 for the max endpoint
+} SapEndpoint;
+
+typedef struct
+{
+    int a; // proxies, a < b
+    int b;
+} SapPair;
+
+// Sweep and prune. The endpoints of every proxy's bounds stay sorted along
+// x and y between steps and are re-sorted with an insertion sort, which is
+// close to linear when bodies move little per step. Each swap of a min and
+// a max endpoint adds or removes a pair depending on whether the two also
+// overlap on the other axis, so the set of overlapping pairs persists and
+// is never searched for.
+typedef struct
+{
+    // Axis the bodies were spread widest on at the last full sort, which
+    // sweeps along it to rebuild the pair set
+    int axis;
+
+    SapEndpoint *endpoints[2];
+    int *position[2]; // where endpoint `data` sits in endpoints[axis]
+    int endpointCount;
+    int endpointCapacity;
+
+    int *proxyBody; // body index of each proxy, -1 when unused
+    int *freeProxies;
+    int freeCount;
+    int *deadProxies; // destroyed, still holding endpoints and pairs
+    int deadCount;
+    int proxyCount; // live proxies
+    int proxyIds;   // ids handed out so far
+    int proxyCapacity;
+    int newProxies; // created since the last update
+
+    // Overlapping pairs, found by proxies through pairIndex
+    SapPair *pairs;
+    int pairCount;
+    int pairCapacity;
+    PairMap pairIndex;
+
+    int *active; // rebuild scratch
+    int *activeSlot;
+    bool built;
+} SweepAndPrune;
+
+int sap_create_proxy(SweepAndPrune *sap, int body);
+
+// The proxy keeps its endpoints and pairs until the next update
+void sap_destroy_proxy(SweepAndPrune *sap, int proxy);
+
+// For when the proxy's body moved to another index
+void sap_set_body(SweepAndPrune *sap, int proxy, int body);
+
+// Re-sorts the endpoints from `bounds` (indexed like bodyAt()) and brings
+// the pair set up to date. Falls back to a full sort when many proxies
+// were created at once.
+void sap_update(SweepAndPrune *sap, int count, AABB *bounds);
+
+// The pair set filtered like broadphase_collect(): at least one body
+// awake, lower index first. Pairs come out in the set's order, which only
+// changes as pairs start and stop overlapping.
+void sap_collect_pairs(SweepAndPrune *sap, PairList *pairs);
+
+void sap_free(SweepAndPrune *sap);
+
+#endif
@@ -9,6 +9,20 @@ typedef struct
     float y;
 } Vec2;
 
+typedef struct
+{
+    Vec2 min;
+    Vec2 max;
+} AABB;
+
+// Rotation followed by a translation; maps a shape's local frame to the world
+typedef struct
+{
+    Vec2 position;
+    float cosRotation;
+    float sinRotation;
+} Transform;
+
 float vec_dot(Vec2 a, Vec2 b);
 Vec2 vec_sub(Vec2 a, Vec2 b);
 float vec_cross(Vec2 a, Vec2 b);
@@ -20,5 +34,11 @@ float vec_length(Vec2 vec);
 bool vec_cmp(Vec2 a, Vec2 b);
 Vec2 vec_scale(Vec2 v, float s);
 Vec2 vec_add(Vec2 a, Vec2 b);
+bool aabb_overlap(AABB a, AABB b);
+AABB aabb_union(AABB a, AABB b);
+Vec2 tf_point(Transform xf, Vec2 local);
+Vec2 tf_vector(Transform xf, Vec2 local);
+Vec2 tf_invPoint(Transform xf, Vec2 world);
+Vec2 tf_invVector(Transform xf, Vec2 world);
 
 #endif
\ No newline at end of file
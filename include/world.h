@@ -0,0 +1,45 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "init_shapes.h"
+#include "paircache.h"
+
+typedef enum
+{
+    BROADPHASE_DYNAMIC_TREE, // incremental tree, resting and static bodies cost nothing
+    BROADPHASE_KDTREE,       // rebuilt from scratch every step
+    BROADPHASE_GRID,         // uniform grid, best for many equal-sized bodies
+    BROADPHASE_SAP           // sweep and prune, keeps its pairs between steps
+} BroadphaseType;
+
+typedef struct
+{
+    AABB bounds;   // walls that dynamic ellipses bounce off
+    float gravity; // downward acceleration applied to dynamic bodies
+
+    bool allowSleep;
+    float sleepVelocity; // bodies slower than this count as resting
+    float timeToSleep;   // seconds a whole island must rest before it sleeps
+
+    int threadCount; // worker threads for the step, 0 uses every CPU
+
+    BroadphaseType broadphase;
+    float gridCellSize; // BROADPHASE_GRID only, 0 sizes cells to the largest dynamic body
+
+    int circleLanes; // circle pairs tested per SIMD instruction, 0 uses the widest the CPU has, 1 is scalar
+} WorldConfig;
+
+WorldConfig world_default_config(void);
+
+void world_init(WorldConfig config);
+void world_step(float dt);
+void world_shutdown(void);
+
+void world_wake_body(Body *body);
+void world_apply_impulse(Body *body, Vec2 impulse);
+
+// Pairs that began, kept or stopped touching during the last step, valid
+// until the next one
+int world_pair_events(const PairEvent **events);
+
+#endif
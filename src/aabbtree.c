@@ -0,0 +1,410 @@
+#include "aabbtree.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Fat boxes also stretch this many steps ahead along the body's motion
+#define AABB_TREE_PREDICTION 2.0f
+
+// Rotations keep the tree close to balanced, and a query needs at most
+// height + 1 stack entries, so it rarely outgrows this many on the stack
+// of the call; past that it moves to the heap
+#define AABB_TREE_STACK_SIZE 128
+
+static float perimeter(AABB box)
+{
+    return 2.0f * ((box.max.x - box.min.x) + (box.max.y - box.min.y));
+}
+
+static bool contains(AABB outer, AABB inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y &&
+           inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+}
+
+static int allocateNode(AABBTree *tree)
+{
+    if (tree->freeList == -1)
+    {
+        int old = tree->capacity;
+        tree->capacity = old ? old * 2 : 64;
+        tree->nodes = realloc(tree->nodes, sizeof(AABBTreeNode) * tree->capacity);
+
+        for (int i = old; i < tree->capacity; i++)
+        {
+            tree->nodes[i].parent = i + 1 < tree->capacity ? i + 1 : -1;
+            tree->nodes[i].height = -1;
+        }
+        tree->freeList = old;
+    }
+
+    int index = tree->freeList;
+    AABBTreeNode *node = &tree->nodes[index];
+    tree->freeList = node->parent;
+
+    node->body = NULL;
+    node->parent = -1;
+    node->child1 = -1;
+    node->child2 = -1;
+    node->height = 0;
+    return index;
+}
+
+static void freeNode(AABBTree *tree, int index)
+{
+    tree->nodes[index].parent = tree->freeList;
+    tree->nodes[index].height = -1;
+    tree->freeList = index;
+}
+
+// Rotates the taller grandchild of `a` above it if its children's heights
+// differ by more than one. Returns the node now at a's position.
+static int balance(AABBTree *tree, int ia)
+{
+    AABBTreeNode *nodes = tree->nodes;
+    AABBTreeNode *a = &nodes[ia];
+
+    if (a->child1 == -1 || a->height < 2)
+        return ia;
+
+    int ib = a->child1;
+    int ic = a->child2;
+    AABBTreeNode *b = &nodes[ib];
+    AABBTreeNode *c = &nodes[ic];
+    int diff = c->height - b->height;
+
+    if (diff > 1)
+    {
+        // Rotate c up
+        int iF = c->child1;
+        int iG = c->child2;
+        AABBTreeNode *f = &nodes[iF];
+        AABBTreeNode *g = &nodes[iG];
+
+        c->child1 = ia;
+        c->parent = a->parent;
+        a->parent = ic;
+
+        if (c->parent == -1)
+            tree->root = ic;
+        else if (nodes[c->parent].child1 == ia)
+            nodes[c->parent].child1 = ic;
+        else
+            nodes[c->parent].child2 = ic;
+
+        // The shorter of c's children moves under a
+        if (f->height > g->height)
+        {
+            c->child2 = iF;
+            a->child2 = iG;
+            g->parent = ia;
+            a->box = aabb_union(b->box, g->box);
+            c->box = aabb_union(a->box, f->box);
+            a->height = 1 + (b->height > g->height ? b->height : g->height);
+            c->height = 1 + (a->height > f->height ? a->height : f->height);
+        }
+        else
+        {
+            c->child2 = iG;
+            a->child2 = iF;
+            f->parent = ia;
+            a->box = aabb_union(b->box, f->box);
+            c->box = aabb_union(a->box, g->box);
+            a->height = 1 + (b->height > f->height ? b->height : f->height);
+            c->height = 1 + (a->height > g->height ? a->height : g->height);
+        }
+
+        return ic;
+    }
+
+    if (diff < -1)
+    {
+        // Rotate b up
+        int iD = b->child1;
+        int iE = b->child2;
+        AABBTreeNode *d = &nodes[iD];
+        AABBTreeNode *e = &nodes[iE];
+
+        b->child1 = ia;
+        b->parent = a->parent;
+        a->parent = ib;
+
+        if (b->parent == -1)
+            tree->root = ib;
+        else if (nodes[b->parent].child1 == ia)
+            nodes[b->parent].child1 = ib;
+        else
+            nodes[b->parent].child2 = ib;
+
+        if (d->height > e->height)
+        {
+            b->child2 = iD;
+            a->child1 = iE;
+            e->parent = ia;
+            a->box = aabb_union(c->box, e->box);
+            b->box = aabb_union(a->box, d->box);
+            a->height = 1 + (c->height > e->height ? c->height : e->height);
+            b->height = 1 + (a->height > d->height ? a->height : d->height);
+        }
+        else
+        {
+            b->child2 = iE;
+            a->child1 = iD;
+            d->parent = ia;
+            a->box = aabb_union(c->box, d->box);
+            b->box = aabb_union(a->box, e->box);
+            a->height = 1 + (c->height > d->height ? c->height : d->height);
+            b->height = 1 + (a->height > e->height ? a->height : e->height);
+        }
+
+        return ib;
+    }
+
+    return ia;
+}
+
+// Refits boxes and heights from `index` up to the root, rebalancing on the way
+static void refitAncestors(AABBTree *tree, int index)
+{
+    while (index != -1)
+    {
+        index = balance(tree, index);
+
+        AABBTreeNode *node = &tree->nodes[index];
+        AABBTreeNode *child1 = &tree->nodes[node->child1];
+        AABBTreeNode *child2 = &tree->nodes[node->child2];
+
+        node->height = 1 + (child1->height > child2->height ? child1->height : child2->height);
+        node->box = aabb_union(child1->box, child2->box);
+
+        index = node->parent;
+    }
+}
+
+static void insertLeaf(AABBTree *tree, int leaf)
+{
+    if (tree->root == -1)
+    {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = -1;
+        return;
+    }
+
+    // Walk down towards the sibling that grows the total perimeter least
+    AABB leafBox = tree->nodes[leaf].box;
+    int index = tree->root;
+
+    while (tree->nodes[index].child1 != -1)
+    {
+        AABBTreeNode *node = &tree->nodes[index];
+        float combined = perimeter(aabb_union(node->box, leafBox));
+
+        // Cost of pairing with this node, and what every level below pays
+        // for this node's box having to grow
+        float cost = 2.0f * combined;
+        float inheritance = 2.0f * (combined - perimeter(node->box));
+
+        float childCost[2];
+        int children[2] = {node->child1, node->child2};
+        for (int i = 0; i < 2; i++)
+        {
+            AABBTreeNode *child = &tree->nodes[children[i]];
+            float grown = perimeter(aabb_union(leafBox, child->box));
+
+            if (child->child1 == -1)
+                childCost[i] = grown + inheritance;
+            else
+                childCost[i] = grown - perimeter(child->box) + inheritance;
+        }
+
+        if (cost < childCost[0] && cost < childCost[1])
+            break;
+
+        index = childCost[0] < childCost[1] ? children[0] : children[1];
+    }
+
+    int sibling = index;
+    int oldParent = tree->nodes[sibling].parent;
+    int newParent = allocateNode(tree);
+
+    AABBTreeNode *nodes = tree->nodes;
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = aabb_union(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent == -1)
+        tree->root = newParent;
+    else if (nodes[oldParent].child1 == sibling)
+        nodes[oldParent].child1 = newParent;
+    else
+        nodes[oldParent].child2 = newParent;
+
+    refitAncestors(tree, newParent);
+}
+
+static void removeLeaf(AABBTree *tree, int leaf)
+{
+    if (leaf == tree->root)
+    {
+        tree->root = -1;
+        return;
+    }
+
+    AABBTreeNode *nodes = tree->nodes;
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    // The sibling takes the parent's place
+    nodes[sibling].parent = grandParent;
+    if (grandParent == -1)
+        tree->root = sibling;
+    else if (nodes[grandParent].child1 == parent)
+        nodes[grandParent].child1 = sibling;
+    else
+        nodes[grandParent].child2 = sibling;
+
+    freeNode(tree, parent);
+    refitAncestors(tree, grandParent);
+}
+
+static AABB fatten(AABB bounds, Vec2 displacement)
+{
+    AABB box = {
+        {bounds.min.x - AABB_TREE_MARGIN, bounds.min.y - AABB_TREE_MARGIN},
+        {bounds.max.x + AABB_TREE_MARGIN, bounds.max.y + AABB_TREE_MARGIN}};
+
+    Vec2 d = vec_scale(displacement, AABB_TREE_PREDICTION);
+    if (d.x < 0.0f)
+        box.min.x += d.x;
+    else
+        box.max.x += d.x;
+    if (d.y < 0.0f)
+        box.min.y += d.y;
+    else
+        box.max.y += d.y;
+
+    return box;
+}
+
+int aabbtree_create_proxy(AABBTree *tree, AABB bounds, Body *body)
+{
+    if (tree->capacity == 0)
+    {
+        tree->root = -1;
+        tree->freeList = -1;
+    }
+
+    int proxy = allocateNode(tree);
+    tree->nodes[proxy].box = fatten(bounds, (Vec2){0.0f, 0.0f});
+    tree->nodes[proxy].body = body;
+
+    insertLeaf(tree, proxy);
+    tree->proxyCount++;
+    return proxy;
+}
+
+void aabbtree_destroy_proxy(AABBTree *tree, int proxy)
+{
+    removeLeaf(tree, proxy);
+    freeNode(tree, proxy);
+    tree->proxyCount--;
+}
+
+bool aabbtree_move_proxy(AABBTree *tree, int proxy, AABB bounds, Vec2 displacement)
+{
+    AABB fat = fatten(bounds, displacement);
+    AABB current = tree->nodes[proxy].box;
+
+    // Still inside its box, and the box has not become needlessly large
+    // since the body slowed down
+    if (contains(current, bounds))
+    {
+        float slack = 4.0f * AABB_TREE_MARGIN;
+        AABB huge = {{fat.min.x - slack, fat.min.y - slack}, {fat.max.x + slack, fat.max.y + slack}};
+
+        if (contains(huge, current))
+            return false;
+    }
+
+    removeLeaf(tree, proxy);
+    tree->nodes[proxy].box = fat;
+    insertLeaf(tree, proxy);
+    return true;
+}
+
+int aabbtree_query(AABBTree *tree, AABB box, Body **out, int maxCount, bool *truncated)
+{
+    int local[AABB_TREE_STACK_SIZE];
+    int *stack = local;
+    int capacity = AABB_TREE_STACK_SIZE;
+    int top = 0;
+    int count = 0;
+
+    if (truncated)
+        *truncated = false;
+
+    if (tree->capacity > 0 && tree->root != -1)
+        stack[top++] = tree->root;
+
+    while (top > 0)
+    {
+        AABBTreeNode *node = &tree->nodes[stack[--top]];
+
+        if (!aabb_overlap(node->box, box))
+            continue;
+
+        if (node->child1 == -1)
+        {
+            if (count == maxCount)
+            {
+                if (truncated)
+                    *truncated = true;
+                break;
+            }
+            out[count++] = node->body;
+        }
+        else
+        {
+            if (top + 2 > capacity)
+            {
+                capacity *= 2;
+                if (stack == local)
+                {
+                    stack = malloc(sizeof(int) * capacity);
+                    for (int i = 0; i < top; i++)
+                        stack[i] = local[i];
+                }
+                else
+                {
+                    stack = realloc(stack, sizeof(int) * capacity);
+                }
+            }
+
+            stack[top++] = node->child2;
+            stack[top++] = node->child1;
+        }
+    }
+
+    if (stack != local)
+        free(stack);
+
+    return count;
+}
+
+int aabbtree_height(AABBTree *tree)
+{
+    if (tree->capacity == 0 || tree->root == -1)
+        return 0;
+
+    return tree->nodes[tree->root].height;
+}
+
+void aabbtree_free(AABBTree *tree)
+{
+    free(tree->nodes);
+    *tree = (AABBTree){0};
+}
@@ -0,0 +1,129 @@
+#include "broadphase.h"
+#include "jobs.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BROADPHASE_GRAIN 128
+
+typedef struct
+{
+    BroadphaseQuery query;
+    void *structure;
+    AABB *bounds;
+} QueryContext;
+
+// Query results, one buffer per worker thread
+static Body **candidates;
+static int candidateCapacity;
+static int candidateThreads;
+
+// Pairs found by each chunk of bodies, merged in chunk order
+static PairList *chunkPairs;
+static int chunkCapacity;
+
+void pairlist_push(PairList *list, Body *a, Body *b)
+{
+    if (list->count >= list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->pairs = realloc(list->pairs, sizeof(BodyPair) * list->capacity);
+    }
+
+    list->pairs[list->count++] = (BodyPair){a, b};
+}
+
+void pairlist_append(PairList *list, PairList *other)
+{
+    if (other->count == 0)
+        return;
+
+    if (list->count + other->count > list->capacity)
+    {
+        list->capacity = (list->count + other->count) * 2;
+        list->pairs = realloc(list->pairs, sizeof(BodyPair) * list->capacity);
+    }
+
+    memcpy(&list->pairs[list->count], other->pairs, sizeof(BodyPair) * other->count);
+    list->count += other->count;
+}
+
+void pairlist_free(PairList *list)
+{
+    free(list->pairs);
+    list->pairs = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+static void queryBodies(void *context, int begin, int end, int thread)
+{
+    QueryContext *search = context;
+    PairList *pairs = &chunkPairs[begin / BROADPHASE_GRAIN];
+    Body **found = &candidates[thread * candidateCapacity];
+
+    unsigned char *flags = bodyState.flags;
+
+    pairs->count = 0;
+
+    // Only awake bodies query the structure; static and sleeping bodies are
+    // found by the awake bodies that touch them
+    for (int i = begin; i < end; i++)
+    {
+        if (!BODY_AWAKE(flags[i]))
+            continue;
+
+        Body *a = bodyAt(i);
+
+        // Room for every body, so the query is never truncated
+        int count = search->query(search->structure, search->bounds[i], found, candidateCapacity, NULL);
+
+        for (int c = 0; c < count; c++)
+        {
+            Body *b = found[c];
+
+            // Structures with enlarged boxes also return near misses
+            if (b == a || !aabb_overlap(search->bounds[i], search->bounds[b->index]))
+                continue;
+
+            // Pairs of awake bodies are found from both sides, keep only one
+            // Pages are not laid out in order, compare indices not pointers
+            if (BODY_AWAKE(flags[b->index]))
+            {
+                if (b->index > i)
+                    pairlist_push(pairs, a, b);
+            }
+            else if (b->index > i)
+                pairlist_push(pairs, a, b);
+            else
+                pairlist_push(pairs, b, a);
+        }
+    }
+}
+
+void broadphase_collect(BroadphaseQuery query, void *structure, AABB *bounds, PairList *pairs)
+{
+    pairs->count = 0;
+
+    // A query can return at most every body once
+    int threads = jobs_thread_count();
+    if (candidateCapacity < body_count || candidateThreads != threads)
+    {
+        candidateCapacity = body_count > candidateCapacity ? body_count : candidateCapacity;
+        candidateThreads = threads;
+        candidates = realloc(candidates, sizeof(Body *) * candidateCapacity * threads);
+    }
+
+    int chunks = jobs_chunk_count(body_count, BROADPHASE_GRAIN);
+    if (chunkCapacity < chunks)
+    {
+        chunkPairs = realloc(chunkPairs, sizeof(PairList) * chunks);
+        memset(&chunkPairs[chunkCapacity], 0, sizeof(PairList) * (chunks - chunkCapacity));
+        chunkCapacity = chunks;
+    }
+
+    QueryContext context = {query, structure, bounds};
+    jobs_parallel_for(body_count, BROADPHASE_GRAIN, queryBodies, &context);
+
+    for (int c = 0; c < chunks; c++)
+        pairlist_append(pairs, &chunkPairs[c]);
+}
@@ -0,0 +1,346 @@
+#include "circlebatch.h"
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define CIRCLEBATCH_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define CIRCLEBATCH_NEON
+#include <arm_neon.h>
+#endif
+
+// Centers closer than this can't give a direction, as in collideCircles()
+#define CIRCLE_EPSILON 1e-8f
+
+typedef void (*CircleKernel)(CircleBatch *batch, int count);
+
+// Every kernel does the same operations in the same order as
+// collideCircles() and isInsideShape(), so unless the compiler fuses
+// multiply-adds they all agree with those to the bit. Whether a filled
+// circle holds the other's center is pointInEllipse() on the center taken
+// into its frame; the other way round the offset between the centers is
+// negated, which is exact.
+
+static unsigned char laneHit(unsigned char filled, int touching, int insideA, int insideB)
+{
+    return touching && !((filled & 1) && insideA) && !((filled & 2) && insideB);
+}
+
+static void runScalar(CircleBatch *batch, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float dx = batch->bx[i] - batch->ax[i];
+        float dy = batch->by[i] - batch->ay[i];
+        float radius = batch->radiusA[i] + batch->radiusB[i];
+        float dist2 = dx * dx + dy * dy;
+        float dist = sqrtf(dist2);
+        float inverse = 1.0f / dist;
+        bool far = dist > CIRCLE_EPSILON;
+
+        float ux = (dx * batch->cosA[i] + dy * batch->sinA[i]) / batch->radiusA[i];
+        float uy = (-dx * batch->sinA[i] + dy * batch->cosA[i]) / batch->radiusA[i];
+        float vx = (-dx * batch->cosB[i] + -dy * batch->sinB[i]) / batch->radiusB[i];
+        float vy = (dx * batch->sinB[i] + -dy * batch->cosB[i]) / batch->radiusB[i];
+
+        batch->hit[i] = laneHit(batch->filled[i], dist2 < radius * radius,
+                                ux * ux + uy * uy <= 1.0f, vx * vx + vy * vy <= 1.0f);
+        batch->normalX[i] = far ? dx * inverse : 1.0f;
+        batch->normalY[i] = far ? dy * inverse : 0.0f;
+        batch->depth[i] = radius - dist;
+    }
+}
+
+#ifdef CIRCLEBATCH_X86
+static void runSSE2(CircleBatch *batch, int count)
+{
+    __m128 epsilon = _mm_set1_ps(CIRCLE_EPSILON);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+
+    for (int i = 0; i < count; i += 4)
+    {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(batch->bx + i), _mm_loadu_ps(batch->ax + i));
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(batch->by + i), _mm_loadu_ps(batch->ay + i));
+        __m128 radiusA = _mm_loadu_ps(batch->radiusA + i);
+        __m128 radiusB = _mm_loadu_ps(batch->radiusB + i);
+        __m128 radius = _mm_add_ps(radiusA, radiusB);
+        __m128 dist2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 dist = _mm_sqrt_ps(dist2);
+        __m128 inverse = _mm_div_ps(one, dist);
+        __m128 far = _mm_cmpgt_ps(dist, epsilon);
+
+        __m128 normalX = _mm_or_ps(_mm_and_ps(far, _mm_mul_ps(dx, inverse)), _mm_andnot_ps(far, one));
+        __m128 normalY = _mm_and_ps(far, _mm_mul_ps(dy, inverse));
+        _mm_storeu_ps(batch->normalX + i, normalX);
+        _mm_storeu_ps(batch->normalY + i, normalY);
+        _mm_storeu_ps(batch->depth + i, _mm_sub_ps(radius, dist));
+
+        __m128 negativeX = _mm_xor_ps(dx, sign);
+        __m128 negativeY = _mm_xor_ps(dy, sign);
+        __m128 cosA = _mm_loadu_ps(batch->cosA + i);
+        __m128 sinA = _mm_loadu_ps(batch->sinA + i);
+        __m128 cosB = _mm_loadu_ps(batch->cosB + i);
+        __m128 sinB = _mm_loadu_ps(batch->sinB + i);
+
+        __m128 ux = _mm_div_ps(_mm_add_ps(_mm_mul_ps(dx, cosA), _mm_mul_ps(dy, sinA)), radiusA);
+        __m128 uy = _mm_div_ps(_mm_add_ps(_mm_mul_ps(negativeX, sinA), _mm_mul_ps(dy, cosA)), radiusA);
+        __m128 vx = _mm_div_ps(_mm_add_ps(_mm_mul_ps(negativeX, cosB), _mm_mul_ps(negativeY, sinB)), radiusB);
+        __m128 vy = _mm_div_ps(_mm_add_ps(_mm_mul_ps(dx, sinB), _mm_mul_ps(negativeY, cosB)), radiusB);
+
+        int touching = _mm_movemask_ps(_mm_cmplt_ps(dist2, _mm_mul_ps(radius, radius)));
+        int insideA = _mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(_mm_mul_ps(ux, ux), _mm_mul_ps(uy, uy)), one));
+        int insideB = _mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), one));
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+            batch->hit[i + lane] = laneHit(batch->filled[i + lane], touching >> lane & 1,
+                                           insideA >> lane & 1, insideB >> lane & 1);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void runAVX2(CircleBatch *batch, int count)
+{
+    __m256 epsilon = _mm256_set1_ps(CIRCLE_EPSILON);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+
+    for (int i = 0; i < count; i += 8)
+    {
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(batch->bx + i), _mm256_loadu_ps(batch->ax + i));
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(batch->by + i), _mm256_loadu_ps(batch->ay + i));
+        __m256 radiusA = _mm256_loadu_ps(batch->radiusA + i);
+        __m256 radiusB = _mm256_loadu_ps(batch->radiusB + i);
+        __m256 radius = _mm256_add_ps(radiusA, radiusB);
+        __m256 dist2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        __m256 dist = _mm256_sqrt_ps(dist2);
+        __m256 inverse = _mm256_div_ps(one, dist);
+        __m256 far = _mm256_cmp_ps(dist, epsilon, _CMP_GT_OQ);
+
+        __m256 normalX = _mm256_blendv_ps(one, _mm256_mul_ps(dx, inverse), far);
+        __m256 normalY = _mm256_and_ps(far, _mm256_mul_ps(dy, inverse));
+        _mm256_storeu_ps(batch->normalX + i, normalX);
+        _mm256_storeu_ps(batch->normalY + i, normalY);
+        _mm256_storeu_ps(batch->depth + i, _mm256_sub_ps(radius, dist));
+
+        __m256 negativeX = _mm256_xor_ps(dx, sign);
+        __m256 negativeY = _mm256_xor_ps(dy, sign);
+        __m256 cosA = _mm256_loadu_ps(batch->cosA + i);
+        __m256 sinA = _mm256_loadu_ps(batch->sinA + i);
+        __m256 cosB = _mm256_loadu_ps(batch->cosB + i);
+        __m256 sinB = _mm256_loadu_ps(batch->sinB + i);
+
+        __m256 ux = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(dx, cosA), _mm256_mul_ps(dy, sinA)), radiusA);
+        __m256 uy = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(negativeX, sinA), _mm256_mul_ps(dy, cosA)), radiusA);
+        __m256 vx = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(negativeX, cosB), _mm256_mul_ps(negativeY, sinB)), radiusB);
+        __m256 vy = _mm256_div_ps(_mm256_add_ps(_mm256_mul_ps(dx, sinB), _mm256_mul_ps(negativeY, cosB)), radiusB);
+
+        __m256 lengthA = _mm256_add_ps(_mm256_mul_ps(ux, ux), _mm256_mul_ps(uy, uy));
+        __m256 lengthB = _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy));
+        int touching = _mm256_movemask_ps(_mm256_cmp_ps(dist2, _mm256_mul_ps(radius, radius), _CMP_LT_OQ));
+        int insideA = _mm256_movemask_ps(_mm256_cmp_ps(lengthA, one, _CMP_LE_OQ));
+        int insideB = _mm256_movemask_ps(_mm256_cmp_ps(lengthB, one, _CMP_LE_OQ));
+
+        for (int lane = 0; lane < 8; lane++)
+        {
+            batch->hit[i + lane] = laneHit(batch->filled[i + lane], touching >> lane & 1,
+                                           insideA >> lane & 1, insideB >> lane & 1);
+        }
+    }
+}
+#endif
+
+#ifdef CIRCLEBATCH_NEON
+static void runNEON(CircleBatch *batch, int count)
+{
+    float32x4_t epsilon = vdupq_n_f32(CIRCLE_EPSILON);
+    float32x4_t one = vdupq_n_f32(1.0f);
+    float32x4_t zero = vdupq_n_f32(0.0f);
+
+    for (int i = 0; i < count; i += 4)
+    {
+        float32x4_t dx = vsubq_f32(vld1q_f32(batch->bx + i), vld1q_f32(batch->ax + i));
+        float32x4_t dy = vsubq_f32(vld1q_f32(batch->by + i), vld1q_f32(batch->ay + i));
+        float32x4_t radiusA = vld1q_f32(batch->radiusA + i);
+        float32x4_t radiusB = vld1q_f32(batch->radiusB + i);
+        float32x4_t radius = vaddq_f32(radiusA, radiusB);
+        float32x4_t dist2 = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy));
+        float32x4_t dist = vsqrtq_f32(dist2);
+        float32x4_t inverse = vdivq_f32(one, dist);
+        uint32x4_t far = vcgtq_f32(dist, epsilon);
+
+        vst1q_f32(batch->normalX + i, vbslq_f32(far, vmulq_f32(dx, inverse), one));
+        vst1q_f32(batch->normalY + i, vbslq_f32(far, vmulq_f32(dy, inverse), zero));
+        vst1q_f32(batch->depth + i, vsubq_f32(radius, dist));
+
+        float32x4_t negativeX = vnegq_f32(dx);
+        float32x4_t negativeY = vnegq_f32(dy);
+        float32x4_t cosA = vld1q_f32(batch->cosA + i);
+        float32x4_t sinA = vld1q_f32(batch->sinA + i);
+        float32x4_t cosB = vld1q_f32(batch->cosB + i);
+        float32x4_t sinB = vld1q_f32(batch->sinB + i);
+
+        float32x4_t ux = vdivq_f32(vaddq_f32(vmulq_f32(dx, cosA), vmulq_f32(dy, sinA)), radiusA);
+        float32x4_t uy = vdivq_f32(vaddq_f32(vmulq_f32(negativeX, sinA), vmulq_f32(dy, cosA)), radiusA);
+        float32x4_t vx = vdivq_f32(vaddq_f32(vmulq_f32(negativeX, cosB), vmulq_f32(negativeY, sinB)), radiusB);
+        float32x4_t vy = vdivq_f32(vaddq_f32(vmulq_f32(dx, sinB), vmulq_f32(negativeY, cosB)), radiusB);
+
+        uint32_t touching[4], insideA[4], insideB[4];
+        vst1q_u32(touching, vcltq_f32(dist2, vmulq_f32(radius, radius)));
+        vst1q_u32(insideA, vcleq_f32(vaddq_f32(vmulq_f32(ux, ux), vmulq_f32(uy, uy)), one));
+        vst1q_u32(insideB, vcleq_f32(vaddq_f32(vmulq_f32(vx, vx), vmulq_f32(vy, vy)), one));
+
+        for (int lane = 0; lane < 4; lane++)
+        {
+            batch->hit[i + lane] = laneHit(batch->filled[i + lane], touching[lane] != 0,
+                                           insideA[lane] != 0, insideB[lane] != 0);
+        }
+    }
+}
+#endif
+
+static CircleKernel kernel = runScalar;
+static int kernelLanes = 1;
+
+static int widestLanes(void)
+{
+#if defined(CIRCLEBATCH_X86)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? 8 : 4;
+#elif defined(CIRCLEBATCH_NEON)
+    return 4;
+#else
+    return 1;
+#endif
+}
+
+int circlebatch_select(int lanes)
+{
+    int widest = widestLanes();
+    if (lanes <= 0 || lanes > widest)
+        lanes = widest;
+
+    kernel = runScalar;
+    kernelLanes = 1;
+
+#if defined(CIRCLEBATCH_X86)
+    if (lanes >= 8)
+    {
+        kernel = runAVX2;
+        kernelLanes = 8;
+    }
+    else if (lanes >= 4)
+    {
+        kernel = runSSE2;
+        kernelLanes = 4;
+    }
+#elif defined(CIRCLEBATCH_NEON)
+    if (lanes >= 4)
+    {
+        kernel = runNEON;
+        kernelLanes = 4;
+    }
+#endif
+
+    return kernelLanes;
+}
+
+int circlebatch_lanes(void)
+{
+    return kernelLanes;
+}
+
+void circlebatch_clear(CircleBatch *batch)
+{
+    batch->count = 0;
+}
+
+void circlebatch_push(CircleBatch *batch, Body *a, Body *b, int pair)
+{
+    // Doubling from 64 keeps the capacity a whole number of groups for
+    // every kernel, padding included
+    if (batch->count == batch->capacity)
+    {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 64;
+        batch->ax = realloc(batch->ax, sizeof(float) * batch->capacity);
+        batch->ay = realloc(batch->ay, sizeof(float) * batch->capacity);
+        batch->radiusA = realloc(batch->radiusA, sizeof(float) * batch->capacity);
+        batch->cosA = realloc(batch->cosA, sizeof(float) * batch->capacity);
+        batch->sinA = realloc(batch->sinA, sizeof(float) * batch->capacity);
+        batch->bx = realloc(batch->bx, sizeof(float) * batch->capacity);
+        batch->by = realloc(batch->by, sizeof(float) * batch->capacity);
+        batch->radiusB = realloc(batch->radiusB, sizeof(float) * batch->capacity);
+        batch->cosB = realloc(batch->cosB, sizeof(float) * batch->capacity);
+        batch->sinB = realloc(batch->sinB, sizeof(float) * batch->capacity);
+        batch->filled = realloc(batch->filled, batch->capacity);
+        batch->pair = realloc(batch->pair, sizeof(int) * batch->capacity);
+        batch->normalX = realloc(batch->normalX, sizeof(float) * batch->capacity);
+        batch->normalY = realloc(batch->normalY, sizeof(float) * batch->capacity);
+        batch->depth = realloc(batch->depth, sizeof(float) * batch->capacity);
+        batch->hit = realloc(batch->hit, batch->capacity);
+    }
+
+    int k = batch->count++;
+    int i = a->index;
+    int j = b->index;
+
+    batch->ax[k] = bodyState.positionX[i];
+    batch->ay[k] = bodyState.positionY[i];
+    batch->radiusA[k] = a->data.ellipse.r.x;
+    batch->cosA[k] = bodyState.cosRotation[i];
+    batch->sinA[k] = bodyState.sinRotation[i];
+    batch->bx[k] = bodyState.positionX[j];
+    batch->by[k] = bodyState.positionY[j];
+    batch->radiusB[k] = b->data.ellipse.r.x;
+    batch->cosB[k] = bodyState.cosRotation[j];
+    batch->sinB[k] = bodyState.sinRotation[j];
+    batch->filled[k] = (a->filled ? 1 : 0) | (b->filled ? 2 : 0);
+    batch->pair[k] = pair;
+}
+
+void circlebatch_run(CircleBatch *batch)
+{
+    // Pairs of points with no radius fill the last group; they never hit
+    int count = (batch->count + kernelLanes - 1) / kernelLanes * kernelLanes;
+    for (int k = batch->count; k < count; k++)
+    {
+        batch->ax[k] = batch->ay[k] = batch->radiusA[k] = batch->cosA[k] = batch->sinA[k] = 0.0f;
+        batch->bx[k] = batch->by[k] = batch->radiusB[k] = batch->cosB[k] = batch->sinB[k] = 0.0f;
+        batch->filled[k] = 0;
+    }
+
+    kernel(batch, count);
+}
+
+void circlebatch_result(CircleBatch *batch, int k, CollisionResult *result)
+{
+    Vec2 center = {batch->ax[k], batch->ay[k]};
+    Vec2 normal = {batch->normalX[k], batch->normalY[k]};
+    float depth = batch->depth[k];
+
+    *result = (CollisionResult){.hit = true, .normal = normal, .depth = depth, .pointCount = 1};
+    result->points[0] = (ContactPoint){vec_add(center, vec_scale(normal, batch->radiusA[k] - depth * 0.5f)), depth, 0};
+}
+
+void circlebatch_free(CircleBatch *batch)
+{
+    free(batch->ax);
+    free(batch->ay);
+    free(batch->radiusA);
+    free(batch->cosA);
+    free(batch->sinA);
+    free(batch->bx);
+    free(batch->by);
+    free(batch->radiusB);
+    free(batch->cosB);
+    free(batch->sinB);
+    free(batch->filled);
+    free(batch->pair);
+    free(batch->normalX);
+    free(batch->normalY);
+    free(batch->depth);
+    free(batch->hit);
+    *batch = (CircleBatch){0};
+}
@@ -2,13 +2,66 @@
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
+#include <stdatomic.h>
 
-Vec2 support(Body *body, Vec2 direction)
+// EPA stops once a new support gets less than this much further out
+#define EPA_TOLERANCE 1e-6f
+#define EPA_MAX_ITERATIONS 128
+#define EPA_LOCAL_EDGES 32
+
+// GJK normally settles in a handful of iterations; near-degenerate shapes
+// can cycle between simplices without ever enclosing the origin
+#define GJK_MAX_ITERATIONS 64
+
+// Convex polygons with more vertices than this find support points by
+// binary search over their edge normals instead of a scan
+#define SUPPORT_SEARCH_VERTICES 16
+
+#define TWO_PI 6.28318531f
+
+// Distances are found to within this
+#define DISTANCE_TOLERANCE 1e-5f
+#define DISTANCE_MAX_ITERATIONS 32
+
+// Time of impact is found once the shapes are within a quarter of the
+// target distance of it
+#define TOI_MAX_ITERATIONS 20
+
+// Vertex furthest along `direction` of a polygon with normalAngles: the
+// one between the last edge whose normal is turned no further than the
+// direction and the edge after it
+static int searchSupport(Body *body, Vec2 direction)
 {
-    if (vec_length(direction) < 1e-8f)
+    float *angles = body->data.polygon.normalAngles;
+    int n = body->data.polygon.numVertices;
+
+    float turn = body->data.polygon.winding * (atan2f(direction.y, direction.x) - body->data.polygon.firstNormalAngle);
+    turn -= floorf(turn / TWO_PI) * TWO_PI;
+
+    int low = 0;
+    int high = n - 1;
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        if (angles[mid] <= turn)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    return (low + 1) % n;
+}
+
+// Furthest point of the shape along `direction` when placed at `xf`. The
+// direction need not be unit length.
+Vec2 support(Body *body, Transform xf, Vec2 direction)
+{
+    if (vec_dot(direction, direction) < 1e-16f)
         direction = (Vec2){1.0f, 0.0f};
-    else
-        direction = vec_normalize(direction);
+
+    // Rotate the direction into the body's local frame instead of moving
+    // every vertex into world space
+    Vec2 localDir = tf_invVector(xf, direction);
 
     switch (body->type)
     {
@@ -17,49 +70,38 @@ Vec2 support(Body *body, Vec2 direction)
         Vec2 *verts = body->data.polygon.vertices;
         int n = body->data.polygon.numVertices;
 
-        Vec2 best = verts[0];
-        float bestDot = vec_dot(best, direction);
+        if (body->data.polygon.normalAngles)
+            return tf_point(xf, verts[searchSupport(body, localDir)]);
+
+        int best = 0;
+        float bestDot = vec_dot(verts[0], localDir);
 
         for (int i = 1; i < n; i++)
         {
-            float d = vec_dot(verts[i], direction);
+            float d = vec_dot(verts[i], localDir);
             if (d > bestDot)
             {
                 bestDot = d;
-                best = verts[i];
+                best = i;
             }
         }
-        return best;
+        return tf_point(xf, verts[best]);
     }
 
     case SHAPE_ELLIPSE:
     {
-        // rotate direction into ellipse local frame
-        float cosA = cosf(-body->data.ellipse.rotation);
-        float sinA = sinf(-body->data.ellipse.rotation);
-
-        Vec2 localDir = {
-            direction.x * cosA - direction.y * sinA,
-            direction.x * sinA + direction.y * cosA};
-
         float rx = body->data.ellipse.r.x;
         float ry = body->data.ellipse.r.y;
 
         float denom = sqrtf((rx * localDir.x) * (rx * localDir.x) + (ry * localDir.y) * (ry * localDir.y));
-        if (denom < 1e-8f)
-            return body->data.ellipse.pos;
+        if (denom <= 0.0f)
+            return xf.position;
 
         Vec2 localPoint = {
             (rx * rx * localDir.x) / denom,
             (ry * ry * localDir.y) / denom};
 
-        // rotate back to world frame
-        cosA = cosf(body->data.ellipse.rotation);
-        sinA = sinf(body->data.ellipse.rotation);
-
-        return (Vec2){
-            localPoint.x * cosA - localPoint.y * sinA + body->data.ellipse.pos.x,
-            localPoint.x * sinA + localPoint.y * cosA + body->data.ellipse.pos.y};
+        return tf_point(xf, localPoint);
     }
 
     case SHAPE_LINE:
@@ -67,10 +109,10 @@ Vec2 support(Body *body, Vec2 direction)
         Vec2 A = body->data.line.vertices[0];
         Vec2 B = body->data.line.vertices[1];
 
-        float da = vec_dot(A, direction);
-        float db = vec_dot(B, direction);
+        float da = vec_dot(A, localDir);
+        float db = vec_dot(B, localDir);
 
-        return (da > db) ? A : B;
+        return tf_point(xf, (da > db) ? A : B);
     }
 
     default:
@@ -78,26 +120,34 @@ Vec2 support(Body *body, Vec2 direction)
     }
 }
 
-bool handleLine(Vec2 *simplex, int *count, Vec2 *dir)
+// Point of the Minkowski difference A - B furthest along `direction`
+static SimplexVertex supportVertex(Body *A, Transform xfA, Body *B, Transform xfB, Vec2 direction)
 {
-    Vec2 A = simplex[*count - 2];
-    Vec2 B = simplex[*count - 1];
+    Vec2 point = vec_sub(support(A, xfA, direction), support(B, xfB, vec_neg(direction)));
+    return (SimplexVertex){point, direction};
+}
+
+bool handleLine(SimplexVertex *simplex, int *count, Vec2 *dir)
+{
+    SimplexVertex first = simplex[*count - 2];
+    Vec2 A = first.point;
+    Vec2 B = simplex[*count - 1].point;
 
     Vec2 AO = vec_neg(A);
     Vec2 AB = vec_sub(B, A);
 
-    Vec2 perp = vec_tripleProduct(AB, AO, AB);
-
-    if (vec_length(perp) < 1e-6)
-    {
-        perp = (Vec2){AB.y, -AB.x};
-    }
+    // Perpendicular facing the origin. Built from AB alone: the triple
+    // product shrinks with the cube of the shape size and fell back to an
+    // arbitrary side for small bodies, missing overlaps.
+    Vec2 perp = {AB.y, -AB.x};
+    if (vec_dot(perp, AO) < 0)
+        perp = vec_neg(perp);
 
     if (vec_dot(AB, AO) > 0)
         *dir = perp;
     else
     {
-        simplex[0] = A;
+        simplex[0] = first;
         *count = 1;
         *dir = AO;
     }
@@ -105,25 +155,33 @@ bool handleLine(Vec2 *simplex, int *count, Vec2 *dir)
     return false;
 }
 
-bool handleTriangle(Vec2 *simplex, int *count, Vec2 *dir)
+bool handleTriangle(SimplexVertex *simplex, int *count, Vec2 *dir)
 {
-    Vec2 A = simplex[2];
-    Vec2 B = simplex[1];
-    Vec2 C = simplex[0];
+    SimplexVertex newest = simplex[2];
+    SimplexVertex middle = simplex[1];
+
+    Vec2 A = newest.point;
+    Vec2 B = middle.point;
+    Vec2 C = simplex[0].point;
 
     Vec2 AO = vec_neg(A);
     Vec2 AB = vec_sub(B, A);
     Vec2 AC = vec_sub(C, A);
 
-    // Compute perpendiculars
-    Vec2 ABperp = vec_tripleProduct(AC, AB, AB);
-    Vec2 ACperp = vec_tripleProduct(AB, AC, AC);
+    // Perpendiculars facing away from the third vertex
+    Vec2 ABperp = {AB.y, -AB.x};
+    if (vec_dot(ABperp, AC) > 0)
+        ABperp = vec_neg(ABperp);
+
+    Vec2 ACperp = {AC.y, -AC.x};
+    if (vec_dot(ACperp, AB) > 0)
+        ACperp = vec_neg(ACperp);
 
     // If origin is outside AB edge
     if (vec_dot(ABperp, AO) > 1e-6f)
     {
-        simplex[0] = B;
-        simplex[1] = A;
+        simplex[0] = middle;
+        simplex[1] = newest;
         *count = 2;
         *dir = ABperp;
         return false;
@@ -132,7 +190,7 @@ bool handleTriangle(Vec2 *simplex, int *count, Vec2 *dir)
     // If origin is outside AC edge
     if (vec_dot(ACperp, AO) > 1e-6f)
     {
-        simplex[1] = A;
+        simplex[1] = newest;
         *count = 2;
         *dir = ACperp;
         return false;
@@ -144,7 +202,7 @@ bool handleTriangle(Vec2 *simplex, int *count, Vec2 *dir)
     return true;
 }
 
-bool handleSimplex(Vec2 *simplex, int *count, Vec2 *dir)
+bool handleSimplex(SimplexVertex *simplex, int *count, Vec2 *dir)
 {
     if (*count == 2)
         return handleLine(simplex, count, dir);
@@ -155,46 +213,436 @@ bool handleSimplex(Vec2 *simplex, int *count, Vec2 *dir)
     return false;
 }
 
-bool checkGJK(Body *A, Body *B, Vec2 simplexOut[3], int *simplexCountOut)
+// handleTriangle() only checks the edges next to the newest vertex; a
+// simplex rebuilt from a cache has no newest vertex, so check all three
+static bool triangleContainsOrigin(SimplexVertex *simplex)
 {
-    Vec2 simplex[3];
+    Vec2 a = simplex[0].point;
+    Vec2 b = simplex[1].point;
+    Vec2 c = simplex[2].point;
+
+    float area = vec_cross(vec_sub(b, a), vec_sub(c, a));
+    if (fabsf(area) < 1e-12f)
+        return false;
+
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    return vec_cross(vec_sub(b, a), vec_neg(a)) * sign >= 0.0f &&
+           vec_cross(vec_sub(c, b), vec_neg(b)) * sign >= 0.0f &&
+           vec_cross(vec_sub(a, c), vec_neg(c)) * sign >= 0.0f;
+}
+
+static void outputSimplex(SimplexVertex *simplex, int count, Vec2 simplexOut[3], int *simplexCountOut)
+{
+    for (int i = 0; i < count; i++)
+        simplexOut[i] = simplex[i].point;
+
+    *simplexCountOut = count;
+}
+
+bool checkGJK(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, Vec2 simplexOut[3], int *simplexCountOut)
+{
+    SimplexVertex simplex[3];
     int count = 0;
 
     // Initial direction
-    Vec2 direction = vec_sub(findCenter(A), findCenter(B));
+    Vec2 direction = vec_sub(xfA.position, xfB.position);
+
+    if (cache && cache->count == 3)
+    {
+        // Bodies that overlapped last step mostly still contain the origin
+        // in the simplex found then, re-evaluated where they are now
+        for (int i = 0; i < 3; i++)
+            simplex[i] = supportVertex(A, xfA, B, xfB, cache->supportDirections[i]);
+
+        if (triangleContainsOrigin(simplex))
+        {
+            outputSimplex(simplex, 3, simplexOut, simplexCountOut);
+            return true;
+        }
+    }
+
+    if (cache && vec_length(cache->direction) > 1e-8f)
+        direction = cache->direction;
+
     if (vec_length(direction) < 1e-8)
         direction = (Vec2){1, 0};
 
-    // First support
-    simplex[count++] = vec_sub(support(A, direction),
-                               support(B, vec_neg(direction)));
+    // First support. Along last step's separating axis it usually shows
+    // the bodies are still apart.
+    simplex[count++] = supportVertex(A, xfA, B, xfB, direction);
+
+    SimplexVertex last = simplex[0];
+    bool hit = vec_dot(last.point, direction) > 0;
+    bool settled = true;
+    if (hit)
+    {
+        direction = vec_neg(simplex[0].point);
+
+        for (int iterations = 0;; iterations++)
+        {
+            // Past the limit the shapes are touching as near as GJK can
+            // tell; report no overlap and nothing known about the gap
+            if (iterations == GJK_MAX_ITERATIONS)
+            {
+                hit = false;
+                settled = false;
+                break;
+            }
+
+            if (vec_length(direction) < 1e-6)
+                direction = (Vec2){-direction.y, direction.x};
+
+            SimplexVertex newVertex = supportVertex(A, xfA, B, xfB, direction);
+
+            // No collision
+            if (vec_dot(newVertex.point, direction) <= 0)
+            {
+                last = newVertex;
+                hit = false;
+                break;
+            }
 
-    direction = vec_neg(simplex[0]);
+            simplex[count++] = newVertex;
 
-    while (1)
+            if (handleSimplex(simplex, &count, &direction))
+                break;
+        }
+    }
+
+    if (cache)
     {
-        if (vec_length(direction) < 1e-6)
-            direction = (Vec2){-direction.y, direction.x};
+        cache->direction = direction;
+        cache->count = hit ? count : 0;
+
+        // Nothing in A - B reaches past the support that showed them apart
+        cache->separation = hit || !settled ? 0.0f : -vec_dot(last.point, direction) / vec_length(direction);
+        for (int i = 0; i < cache->count; i++)
+            cache->supportDirections[i] = simplex[i].direction;
+    }
 
-        Vec2 newPoint = vec_sub(support(A, direction),
-                                support(B, vec_neg(direction)));
+    if (hit)
+        outputSimplex(simplex, count, simplexOut, simplexCountOut);
 
-        // No collision
-        if (vec_dot(newPoint, direction) <= 0)
-            return false;
+    return hit;
+}
+
+typedef struct
+{
+    Vec2 a; // support on A
+    Vec2 b; // support on B
+    Vec2 w; // a - b
+    float u; // barycentric weight in the closest point
+} DistanceVertex;
+
+static DistanceVertex distanceVertex(Body *A, Transform xfA, Body *B, Transform xfB, Vec2 direction)
+{
+    Vec2 a = support(A, xfA, direction);
+    Vec2 b = support(B, xfB, vec_neg(direction));
+    return (DistanceVertex){a, b, vec_sub(a, b), 1.0f};
+}
+
+// Reduces a segment simplex to the part closest to the origin
+static void solveSegment(DistanceVertex *v, int *count)
+{
+    Vec2 e = vec_sub(v[1].w, v[0].w);
+
+    float d2 = -vec_dot(v[0].w, e);
+    if (d2 <= 0.0f)
+    {
+        v[0].u = 1.0f;
+        *count = 1;
+        return;
+    }
+
+    float d1 = vec_dot(v[1].w, e);
+    if (d1 <= 0.0f)
+    {
+        v[0] = v[1];
+        v[0].u = 1.0f;
+        *count = 1;
+        return;
+    }
+
+    v[0].u = d1 / (d1 + d2);
+    v[1].u = d2 / (d1 + d2);
+}
+
+// Same for a triangle, by the Voronoi regions of its vertices and edges
+static void solveTriangle(DistanceVertex *v, int *count)
+{
+    Vec2 w1 = v[0].w;
+    Vec2 w2 = v[1].w;
+    Vec2 w3 = v[2].w;
+
+    Vec2 e12 = vec_sub(w2, w1);
+    float d12_1 = vec_dot(w2, e12);
+    float d12_2 = -vec_dot(w1, e12);
+
+    Vec2 e13 = vec_sub(w3, w1);
+    float d13_1 = vec_dot(w3, e13);
+    float d13_2 = -vec_dot(w1, e13);
+
+    Vec2 e23 = vec_sub(w3, w2);
+    float d23_1 = vec_dot(w3, e23);
+    float d23_2 = -vec_dot(w2, e23);
+
+    float n123 = vec_cross(e12, e13);
+    float d123_1 = n123 * vec_cross(w2, w3);
+    float d123_2 = n123 * vec_cross(w3, w1);
+    float d123_3 = n123 * vec_cross(w1, w2);
+
+    if (d12_2 <= 0.0f && d13_2 <= 0.0f)
+    {
+        v[0].u = 1.0f;
+        *count = 1;
+    }
+    else if (d12_1 > 0.0f && d12_2 > 0.0f && d123_3 <= 0.0f)
+    {
+        v[0].u = d12_1 / (d12_1 + d12_2);
+        v[1].u = d12_2 / (d12_1 + d12_2);
+        *count = 2;
+    }
+    else if (d13_1 > 0.0f && d13_2 > 0.0f && d123_2 <= 0.0f)
+    {
+        v[0].u = d13_1 / (d13_1 + d13_2);
+        v[2].u = d13_2 / (d13_1 + d13_2);
+        v[1] = v[2];
+        *count = 2;
+    }
+    else if (d12_1 <= 0.0f && d23_2 <= 0.0f)
+    {
+        v[0] = v[1];
+        v[0].u = 1.0f;
+        *count = 1;
+    }
+    else if (d13_1 <= 0.0f && d23_1 <= 0.0f)
+    {
+        v[0] = v[2];
+        v[0].u = 1.0f;
+        *count = 1;
+    }
+    else if (d23_1 > 0.0f && d23_2 > 0.0f && d123_1 <= 0.0f)
+    {
+        v[1].u = d23_1 / (d23_1 + d23_2);
+        v[2].u = d23_2 / (d23_1 + d23_2);
+        v[0] = v[2];
+        *count = 2;
+    }
+    else
+    {
+        // The origin is inside
+        float sum = d123_1 + d123_2 + d123_3;
+        v[0].u = d123_1 / sum;
+        v[1].u = d123_2 / sum;
+        v[2].u = d123_3 / sum;
+        *count = 3;
+    }
+}
+
+static bool isCircleShape(Body *body)
+{
+    return body->type == SHAPE_ELLIPSE && body->data.ellipse.r.x == body->data.ellipse.r.y;
+}
+
+static bool circleDistance(Body *A, Transform xfA, Body *B, Transform xfB, DistanceResult *out)
+{
+    Vec2 d = vec_sub(xfB.position, xfA.position);
+    float length = vec_length(d);
+    Vec2 normal = length > 1e-8f ? vec_scale(d, 1.0f / length) : (Vec2){1.0f, 0.0f};
+
+    out->distance = fmaxf(length - A->data.ellipse.r.x - B->data.ellipse.r.x, 0.0f);
+    out->lowerBound = out->distance;
+    out->pointA = vec_add(xfA.position, vec_scale(normal, A->data.ellipse.r.x));
+    out->pointB = vec_sub(xfB.position, vec_scale(normal, B->data.ellipse.r.x));
+    out->normal = out->distance > 0.0f ? normal : (Vec2){0.0f, 0.0f};
+    out->iterations = 0;
+    return out->distance > 0.0f;
+}
+
+bool checkDistanceGJK(Body *A, Transform xfA, Body *B, Transform xfB, DistanceResult *out)
+{
+    if (isCircleShape(A) && isCircleShape(B))
+        return circleDistance(A, xfA, B, xfB, out);
+
+    DistanceVertex v[3];
+    int count = 1;
+    v[0] = distanceVertex(A, xfA, B, xfB, vec_sub(xfB.position, xfA.position));
+
+    float lowerBound = 0.0f;
+    float previous = FLT_MAX;
+    int iterations = 0;
+    Vec2 closest = v[0].w;
+
+    while (iterations < DISTANCE_MAX_ITERATIONS)
+    {
+        if (count == 2)
+            solveSegment(v, &count);
+        else if (count == 3)
+            solveTriangle(v, &count);
+
+        if (count == 3)
+            break;
+
+        closest = (Vec2){0.0f, 0.0f};
+        for (int i = 0; i < count; i++)
+            closest = vec_add(closest, vec_scale(v[i].w, v[i].u));
+
+        // Each support has to bring the simplex closer; rounding in the
+        // closest point can keep the gap below from ever closing
+        float length = vec_length(closest);
+        if (length < DISTANCE_TOLERANCE || length >= previous)
+            break;
+        previous = length;
+
+        // Nothing in A - B reaches further towards the origin than the new
+        // support, which bounds the distance from below
+        Vec2 direction = vec_scale(closest, -1.0f / length);
+        DistanceVertex next = distanceVertex(A, xfA, B, xfB, direction);
+        iterations++;
+
+        lowerBound = fmaxf(lowerBound, -vec_dot(next.w, direction));
+        if (length - lowerBound < DISTANCE_TOLERANCE)
+            break;
+
+        v[count++] = next;
+    }
 
-        simplex[count++] = newPoint;
+    Vec2 pointA = {0.0f, 0.0f};
+    Vec2 pointB = {0.0f, 0.0f};
+    for (int i = 0; i < count; i++)
+    {
+        pointA = vec_add(pointA, vec_scale(v[i].a, v[i].u));
+        pointB = vec_add(pointB, vec_scale(v[i].b, v[i].u));
+    }
+
+    float distance = count == 3 ? 0.0f : vec_length(closest);
+
+    out->pointA = pointA;
+    out->pointB = pointB;
+    out->iterations = iterations;
+
+    if (distance < DISTANCE_TOLERANCE)
+    {
+        out->distance = 0.0f;
+        out->lowerBound = 0.0f;
+        out->normal = (Vec2){0.0f, 0.0f};
+        return false;
+    }
 
-        if (handleSimplex(simplex, &count, &direction))
+    out->distance = distance;
+    out->lowerBound = fminf(lowerBound, distance);
+    out->normal = vec_scale(closest, -1.0f / distance);
+    return true;
+}
+
+bool bodyDistance(Body *A, Body *B, DistanceResult *out)
+{
+    int aCount, bCount;
+    Body *aParts = convexParts(A, &aCount);
+    Body *bParts = convexParts(B, &bCount);
+    Transform xfA = getTransform(A);
+    Transform xfB = getTransform(B);
+
+    bool apart = true;
+    float lowerBound = FLT_MAX;
+    int iterations = 0;
+    out->distance = FLT_MAX;
+
+    for (int i = 0; i < aCount; i++)
+    {
+        Transform partA = partTransform(A, xfA, i);
+
+        for (int j = 0; j < bCount; j++)
         {
-            // OUTPUT SIMPLEX CLEANLY
-            for (int i = 0; i < count; i++)
-                simplexOut[i] = simplex[i];
+            DistanceResult part;
+            apart &= checkDistanceGJK(&aParts[i], partA, &bParts[j], partTransform(B, xfB, j), &part);
+
+            lowerBound = fminf(lowerBound, part.lowerBound);
+            iterations += part.iterations;
+            if (part.distance < out->distance)
+                *out = part;
+        }
+    }
+
+    out->lowerBound = lowerBound;
+    out->iterations = iterations;
+    return apart;
+}
+
+// Conservative advancement: the gap along the closest points' normal
+// closes no faster than the motion along that normal, so A can always be
+// moved that far without passing through B
+bool checkTimeOfImpact(Body *A, Transform xfA, Vec2 translation, Body *B, Transform xfB, float target, TOIResult *out)
+{
+    float tolerance = target * 0.25f;
+    float t = 0.0f;
 
-            *simplexCountOut = count;
+    *out = (TOIResult){.t = 1.0f};
+
+    for (int iterations = 1; iterations <= TOI_MAX_ITERATIONS; iterations++)
+    {
+        Transform moved = xfA;
+        moved.position = vec_add(xfA.position, vec_scale(translation, t));
+
+        DistanceResult distance;
+        if (!checkDistanceGJK(A, moved, B, xfB, &distance))
+            return false;
+
+        out->iterations = iterations;
+
+        float approach = vec_dot(translation, distance.normal);
+        if (approach <= 0.0f)
+            return false;
+
+        out->normal = distance.normal;
+        out->point = distance.pointB;
+
+        if (distance.distance < target + tolerance)
+        {
+            out->hit = true;
+            out->t = t;
             return true;
         }
+
+        t += (distance.distance - target) / approach;
+        if (t >= 1.0f)
+            return false;
+    }
+
+    // Still short of the target, which is as safe a place to stop as any
+    out->hit = true;
+    out->t = t;
+    return true;
+}
+
+bool bodyTimeOfImpact(Body *A, Vec2 translation, Body *B, float target, TOIResult *out)
+{
+    int aCount, bCount;
+    Body *aParts = convexParts(A, &aCount);
+    Body *bParts = convexParts(B, &bCount);
+    Transform xfA = getTransform(A);
+    Transform xfB = getTransform(B);
+
+    int iterations = 0;
+    *out = (TOIResult){.t = 1.0f};
+
+    for (int i = 0; i < aCount; i++)
+    {
+        Transform partA = partTransform(A, xfA, i);
+
+        for (int j = 0; j < bCount; j++)
+        {
+            TOIResult part;
+            checkTimeOfImpact(&aParts[i], partA, translation, &bParts[j], partTransform(B, xfB, j), target, &part);
+
+            iterations += part.iterations;
+            if (part.hit && part.t < out->t)
+                *out = part;
+        }
     }
+
+    out->iterations = iterations;
+    return out->hit;
 }
 
 bool polygonIsConvex(Vec2 *p, int n)
@@ -215,90 +663,322 @@ bool polygonIsConvex(Vec2 *p, int n)
     return true;
 }
 
-CollisionResult calculateEPA(Body *A, Body *B, Vec2 simplex[3], int simplexCount)
+static void buildNormalAngles(Body *body)
 {
-    const float EPS = 1e-8f;
-    const int MAX_ITER = 64;
-    Vec2 poly[64];
-    int count = simplexCount;
+    Vec2 *normals = body->data.polygon.normals;
+    int n = body->data.polygon.numVertices;
 
-    // Copy simplex into polytope
-    for (int i = 0; i < count; i++)
-        poly[i] = simplex[i];
+    // Collinear edges share a normal; the first turn tells the winding
+    float winding = 1.0f;
+    for (int i = 0; i < n; i++)
+    {
+        float turn = vec_cross(normals[i], normals[(i + 1) % n]);
+        if (fabsf(turn) > 1e-6f)
+        {
+            winding = turn > 0.0f ? 1.0f : -1.0f;
+            break;
+        }
+    }
 
-    for (int iter = 0; iter < MAX_ITER; iter++)
+    float first = atan2f(normals[0].y, normals[0].x);
+    float *angles = malloc(sizeof(float) * n);
+    angles[0] = 0.0f;
+
+    for (int i = 1; i < n; i++)
     {
-        float minDist = FLT_MAX;
-        int edge = -1;
-        Vec2 bestNormal = {0.0f, 0.0f};
+        float turn = winding * (atan2f(normals[i].y, normals[i].x) - first);
+        turn -= floorf(turn / TWO_PI) * TWO_PI;
 
-        for (int i = 0; i < count; i++)
+        // Rounding must not let an angle fall behind the one before it,
+        // nor wrap a normal equal to the first one around to 2 pi
+        angles[i] = fmaxf(turn < TWO_PI - 1e-6f ? turn : 0.0f, angles[i - 1]);
+    }
+
+    body->data.polygon.normalAngles = angles;
+    body->data.polygon.firstNormalAngle = first;
+    body->data.polygon.winding = winding;
+}
+
+// Triangulates a concave polygon on first use. Call once per step before
+// any convexParts() lookups, which only read the cache.
+void updateConvexParts(Body *body)
+{
+    if (body->type != SHAPE_POLYGON || body->data.polygon.decomposed)
+        return;
+
+    int n = body->data.polygon.numVertices;
+
+    body->data.polygon.decomposed = true;
+    body->data.polygon.convex = polygonIsConvex(body->data.polygon.vertices, n);
+
+    if (body->data.polygon.convex && n > SUPPORT_SEARCH_VERTICES)
+        buildNormalAngles(body);
+
+    if (!body->data.polygon.convex)
+    {
+        int indices[3 * (n - 2)];
+        int triangleCount;
+        decompose(body, indices, &triangleCount);
+
+        Body *parts = calloc(triangleCount, sizeof(Body));
+        Vec2 *offsets = malloc(sizeof(Vec2) * triangleCount);
+        Vec2 *vertices = malloc(sizeof(Vec2) * 3 * triangleCount);
+        Vec2 *normals = malloc(sizeof(Vec2) * 3 * triangleCount);
+
+        // Each triangle is centered on its own vertex average, which sits
+        // at a fixed offset in the polygon's local frame
+        for (int t = 0; t < triangleCount; t++)
         {
-            Vec2 a = poly[i];
-            Vec2 b = poly[(i + 1) % count];
-            Vec2 e = vec_sub(b, a);
+            Vec2 a = body->data.polygon.vertices[indices[t * 3]];
+            Vec2 b = body->data.polygon.vertices[indices[t * 3 + 1]];
+            Vec2 c = body->data.polygon.vertices[indices[t * 3 + 2]];
+
+            offsets[t] = (Vec2){(a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f};
+            vertices[t * 3] = vec_sub(a, offsets[t]);
+            vertices[t * 3 + 1] = vec_sub(b, offsets[t]);
+            vertices[t * 3 + 2] = vec_sub(c, offsets[t]);
+            computeEdgeNormals(&vertices[t * 3], 3, &normals[t * 3]);
+
+            parts[t].id = body->id;
+            parts[t].index = -1;
+            parts[t].type = SHAPE_POLYGON;
+            parts[t].data.polygon.vertices = &vertices[t * 3];
+            parts[t].data.polygon.normals = &normals[t * 3];
+            parts[t].data.polygon.numVertices = 3;
+            parts[t].data.polygon.decomposed = true;
+            parts[t].data.polygon.convex = true;
+        }
 
-            Vec2 n = (Vec2){e.y, -e.x};
-            n = vec_normalize(n);
+        body->data.polygon.parts = parts;
+        body->data.polygon.partOffsets = offsets;
+        body->data.polygon.partCount = triangleCount;
+    }
+}
 
-            float dist = vec_dot(n, a);
+// Returns the convex pieces to collide: the body itself unless it is a
+// concave polygon, in which case its cached triangulation is returned
+Body *convexParts(Body *body, int *count)
+{
+    if (body->type != SHAPE_POLYGON || body->data.polygon.partCount == 0)
+    {
+        *count = 1;
+        return body;
+    }
 
-            if (dist < 0)
-            {
-                n = vec_neg(n);
-                dist = -dist;
-            }
+    *count = body->data.polygon.partCount;
+    return body->data.polygon.parts;
+}
 
-            if (dist < minDist)
-            {
-                minDist = dist;
-                bestNormal = n;
-                edge = i;
-            }
+// Where part `part` of convexParts() sits when the body is placed at `xf`
+Transform partTransform(Body *body, Transform xf, int part)
+{
+    if (body->type == SHAPE_POLYGON && body->data.polygon.partCount > 0)
+        xf.position = tf_point(xf, body->data.polygon.partOffsets[part]);
+
+    return xf;
+}
+
+typedef struct
+{
+    Vec2 a;
+    Vec2 b;
+    Vec2 normal;    // unit, facing away from the origin
+    float distance; // of the edge's line from the origin
+} EPAEdge;
+
+// Edges of the polytope in a binary min-heap on distance. The first
+// EPA_LOCAL_EDGES live on the stack; past that they move to the heap.
+typedef struct
+{
+    EPAEdge *edges;
+    int count;
+    int capacity;
+    EPAEdge local[EPA_LOCAL_EDGES];
+} EPAQueue;
+
+static atomic_int epaRuns;
+static atomic_int epaIterations;
+static atomic_int epaMaxIterations;
+static atomic_int epaTruncated;
+
+static void pushEdge(EPAQueue *queue, Vec2 a, Vec2 b)
+{
+    Vec2 e = vec_sub(b, a);
+    float length = vec_length(e);
+
+    // Two supports that came out the same add nothing to the polytope
+    if (length < 1e-12f)
+        return;
+
+    Vec2 n = vec_scale((Vec2){e.y, -e.x}, 1.0f / length);
+    float distance = vec_dot(n, a);
+    if (distance < 0)
+    {
+        n = vec_neg(n);
+        distance = -distance;
+    }
+
+    if (queue->count == queue->capacity)
+    {
+        queue->capacity *= 2;
+        if (queue->edges == queue->local)
+        {
+            queue->edges = malloc(sizeof(EPAEdge) * queue->capacity);
+            for (int i = 0; i < queue->count; i++)
+                queue->edges[i] = queue->local[i];
         }
+        else
+        {
+            queue->edges = realloc(queue->edges, sizeof(EPAEdge) * queue->capacity);
+        }
+    }
 
-        if (edge < 0)
-            return (CollisionResult){.hit = false};
+    EPAEdge *edges = queue->edges;
+    int i = queue->count++;
 
-        Vec2 p = vec_sub(
-            support(A, bestNormal),
-            support(B, vec_neg(bestNormal)));
+    while (i > 0 && edges[(i - 1) / 2].distance > distance)
+    {
+        edges[i] = edges[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    edges[i] = (EPAEdge){a, b, n, distance};
+}
+
+static void popEdge(EPAQueue *queue)
+{
+    EPAEdge *edges = queue->edges;
+    EPAEdge last = edges[--queue->count];
+    int i = 0;
+
+    for (;;)
+    {
+        int child = i * 2 + 1;
+        if (child >= queue->count)
+            break;
+        if (child + 1 < queue->count && edges[child + 1].distance < edges[child].distance)
+            child++;
+        if (edges[child].distance >= last.distance)
+            break;
+
+        edges[i] = edges[child];
+        i = child;
+    }
+    edges[i] = last;
+}
+
+static void recordEPA(int iterations, bool truncated)
+{
+    atomic_fetch_add(&epaRuns, 1);
+    atomic_fetch_add(&epaIterations, iterations);
+    if (truncated)
+        atomic_fetch_add(&epaTruncated, 1);
+
+    int max = atomic_load(&epaMaxIterations);
+    while (iterations > max && !atomic_compare_exchange_weak(&epaMaxIterations, &max, iterations))
+    {
+    }
+}
+
+// Expands the GJK simplex towards the boundary of A - B, always splitting
+// the edge closest to the origin, until the support along its normal gets
+// no further out. The closest edge then gives the normal and depth.
+CollisionResult calculateEPA(Body *A, Transform xfA, Body *B, Transform xfB, Vec2 simplex[3], int simplexCount)
+{
+    EPAQueue queue;
+    queue.edges = queue.local;
+    queue.count = 0;
+    queue.capacity = EPA_LOCAL_EDGES;
+
+    for (int i = 0; i < simplexCount; i++)
+        pushEdge(&queue, simplex[i], simplex[(i + 1) % simplexCount]);
 
-        float pDist = vec_dot(bestNormal, p);
+    CollisionResult result = {.hit = false};
+    int iterations = 0;
+    bool truncated = false;
 
-        if (pDist - minDist < EPS)
+    while (queue.count > 0)
+    {
+        EPAEdge closest = queue.edges[0];
+        result = (CollisionResult){.hit = true, .normal = closest.normal, .depth = closest.distance};
+
+        // Curved shapes only get closer and closer to their boundary; past
+        // the limit the closest edge found so far is the answer
+        if (iterations == EPA_MAX_ITERATIONS)
         {
-            return (CollisionResult){
-                .hit = true,
-                .normal = bestNormal,
-                .depth = minDist};
+            truncated = true;
+            break;
         }
+        iterations++;
 
-        for (int i = count; i > edge + 1; i--)
-            poly[i] = poly[i - 1];
-        poly[edge + 1] = p;
-        count++;
+        Vec2 p = vec_sub(
+            support(A, xfA, closest.normal),
+            support(B, xfB, vec_neg(closest.normal)));
 
-        if (count >= 63)
+        if (vec_dot(closest.normal, p) - closest.distance < EPA_TOLERANCE)
             break;
+
+        popEdge(&queue);
+        pushEdge(&queue, closest.a, p);
+        pushEdge(&queue, p, closest.b);
     }
 
-    return (CollisionResult){.hit = false};
+    recordEPA(iterations, truncated);
+
+    if (queue.edges != queue.local)
+        free(queue.edges);
+
+    return result;
 }
 
-bool checkCollision(Body *A, Body *B, CollisionResult *out)
+EPAStats getEPAStats(void)
+{
+    return (EPAStats){
+        atomic_load(&epaRuns),
+        atomic_load(&epaIterations),
+        atomic_load(&epaMaxIterations),
+        atomic_load(&epaTruncated)};
+}
+
+void resetEPAStats(void)
+{
+    atomic_store(&epaRuns, 0);
+    atomic_store(&epaIterations, 0);
+    atomic_store(&epaMaxIterations, 0);
+    atomic_store(&epaTruncated, 0);
+}
+
+bool checkCollisionGJK(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *out)
 {
     Vec2 simplex[3];
     int simplexCount = 0;
 
     // Run GJK
-    if (!checkGJK(A, B, simplex, &simplexCount))
+    if (!checkGJK(A, xfA, B, xfB, cache, simplex, &simplexCount))
     {
         out->hit = false;
         return false;
     }
 
     // Run EPA
-    *out = calculateEPA(A, B, simplex, simplexCount);
+    *out = calculateEPA(A, xfA, B, xfB, simplex, simplexCount);
+
+    if (out->hit)
+    {
+        // One point, halfway into the overlap from the deepest point of a
+        // curved shape; the support of a flat side is any of its corners
+        Vec2 halfDepth = vec_scale(out->normal, out->depth * 0.5f);
+        Vec2 point;
+
+        if (A->type == SHAPE_ELLIPSE)
+            point = vec_sub(support(A, xfA, out->normal), halfDepth);
+        else if (B->type == SHAPE_ELLIPSE)
+            point = vec_add(support(B, xfB, vec_neg(out->normal)), halfDepth);
+        else
+            point = vec_scale(vec_add(support(A, xfA, out->normal), support(B, xfB, vec_neg(out->normal))), 0.5f);
+
+        out->points[0] = (ContactPoint){point, out->depth, 0};
+        out->pointCount = 1;
+    }
+
     return out->hit;
 }
\ No newline at end of file
@@ -4,160 +4,207 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 
 static GLuint VAO_global;
 static GLuint VBO_global;
-static GLint colorLocation_global;
+static GLuint shapeProgram_global;
 
-void initDraw(GLuint vao, GLuint vbo, GLint colorLoc)
+// Segments of the shared unit circle every ellipse instance is drawn with
+#define ELLIPSE_SEGMENTS 48
+
+static GLuint ellipseProgram_global;
+static GLuint ellipseVAO;
+static GLuint ellipseMeshVBO;
+static GLuint ellipseInstanceVBO;
+
+typedef struct
 {
-    VAO_global = vao;
-    VBO_global = vbo;
-    colorLocation_global = colorLoc;
-}
+    float x;
+    float y;
+    Color color;
+} Vertex;
 
-void setColor(Color color)
+typedef struct
 {
-    glUniform4f(colorLocation_global, color.r, color.g, color.b, color.a);
-}
+    Vertex *vertices;
+    int count;
+    int capacity;
+} VertexBatch;
 
-void drawEllipse(Body *body)
+typedef struct
 {
-    if (body->type != SHAPE_ELLIPSE || body_count >= MAX_SHAPES)
-        return;
+    Vec2 center;
+    Vec2 radii;
+    float cosRotation;
+    float sinRotation;
+    Color color;
+} EllipseInstance;
+
+typedef struct
+{
+    EllipseInstance *instances;
+    int count;
+    int capacity;
+} EllipseBatch;
+
+// Everything queued this frame; filled shapes go out as GL_TRIANGLES and
+// outlines as GL_LINES. Ellipses are only a transform and a color each and
+// are expanded from the unit circle mesh in the vertex shader.
+static VertexBatch triangles;
+static VertexBatch lines;
+static EllipseBatch filledEllipses;
+static EllipseBatch outlinedEllipses;
+
+// Points the per-instance attributes at the instance at `first` in the
+// instance buffer; GL 3.3 has no base instance for draw calls
+static void bindEllipseInstances(int first)
+{
+    size_t base = sizeof(EllipseInstance) * first;
 
-    int steps = (int)ceilf(body->data.ellipse.r.x * 200.0f);
-    if (steps < 24)
-        steps = 24;
-    if (steps > 64)
-        steps = 64;
+    glBindBuffer(GL_ARRAY_BUFFER, ellipseInstanceVBO);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(EllipseInstance), (void *)(base + offsetof(EllipseInstance, center)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(EllipseInstance), (void *)(base + offsetof(EllipseInstance, radii)));
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(EllipseInstance), (void *)(base + offsetof(EllipseInstance, cosRotation)));
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(EllipseInstance), (void *)(base + offsetof(EllipseInstance, color)));
+}
 
-    float angStep = 2.0f * M_PI / steps;
+static void initEllipseMesh(void)
+{
+    // Fill triangles around the center first, then the outline segments
+    Vec2 mesh[ELLIPSE_SEGMENTS * 5];
+    float angStep = 2.0f * M_PI / ELLIPSE_SEGMENTS;
 
-    setColor(body->color);
+    for (int i = 0; i < ELLIPSE_SEGMENTS; i++)
+    {
+        Vec2 a = {cosf(i * angStep), sinf(i * angStep)};
+        Vec2 b = {cosf((i + 1) * angStep), sinf((i + 1) * angStep)};
+
+        mesh[i * 3] = (Vec2){0.0f, 0.0f};
+        mesh[i * 3 + 1] = a;
+        mesh[i * 3 + 2] = b;
+        mesh[ELLIPSE_SEGMENTS * 3 + i * 2] = a;
+        mesh[ELLIPSE_SEGMENTS * 3 + i * 2 + 1] = b;
+    }
 
-    float cosA = cosf(body->data.ellipse.rotation);
-    float sinA = sinf(body->data.ellipse.rotation);
-    Vec2 center = body->data.ellipse.pos;
+    glGenVertexArrays(1, &ellipseVAO);
+    glGenBuffers(1, &ellipseMeshVBO);
+    glGenBuffers(1, &ellipseInstanceVBO);
 
-    if (body->filled)
-    {
-        float verts[(steps + 2) * 2];
+    glBindVertexArray(ellipseVAO);
 
-        // Center vertex
-        verts[0] = center.x;
-        verts[1] = center.y;
+    glBindBuffer(GL_ARRAY_BUFFER, ellipseMeshVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(mesh), mesh, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vec2), (void *)0);
+    glEnableVertexAttribArray(0);
 
-        for (int i = 0; i <= steps; i++)
-        {
-            float t = i * angStep;
+    bindEllipseInstances(0);
+    for (int attribute = 1; attribute <= 4; attribute++)
+    {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+}
 
-            // Axis-aligned ellipse point
-            float x = cosf(t) * body->data.ellipse.r.x;
-            float y = sinf(t) * body->data.ellipse.r.y;
+void initDraw(GLuint vao, GLuint vbo, GLuint shapeProgram, GLuint ellipseProgram)
+{
+    VAO_global = vao;
+    VBO_global = vbo;
+    shapeProgram_global = shapeProgram;
+    ellipseProgram_global = ellipseProgram;
 
-            // Rotate point by body->rotation
-            float xr = x * cosA - y * sinA;
-            float yr = x * sinA + y * cosA;
+    // The VAO keeps this layout; flushDraw() only replaces the buffer contents
+    glBindVertexArray(VAO_global);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_global);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, x));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, color));
+    glEnableVertexAttribArray(1);
 
-            verts[2 + 2 * i] = center.x + xr;
-            verts[2 + 2 * i + 1] = center.y + yr;
-        }
+    initEllipseMesh();
+}
 
-        glBindVertexArray(VAO_global);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_global);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(0);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, steps + 2);
-    }
-    else
+// Returns room for `count` more vertices at the end of the batch
+static Vertex *reserveVertices(VertexBatch *batch, int count)
+{
+    if (batch->count + count > batch->capacity)
     {
-        float verts[(steps + 1) * 2];
+        batch->capacity = (batch->count + count) * 2;
+        batch->vertices = realloc(batch->vertices, sizeof(Vertex) * batch->capacity);
+    }
 
-        for (int i = 0; i <= steps; i++)
-        {
-            float t = i * angStep;
+    Vertex *out = &batch->vertices[batch->count];
+    batch->count += count;
+    return out;
+}
+
+static void pushTriangle(Vec2 a, Vec2 b, Vec2 c, Color color)
+{
+    Vertex *v = reserveVertices(&triangles, 3);
+    v[0] = (Vertex){a.x, a.y, color};
+    v[1] = (Vertex){b.x, b.y, color};
+    v[2] = (Vertex){c.x, c.y, color};
+}
 
-            float x = cosf(t) * body->data.ellipse.r.x;
-            float y = sinf(t) * body->data.ellipse.r.y;
+static void pushSegment(Vec2 a, Vec2 b, Color color)
+{
+    Vertex *v = reserveVertices(&lines, 2);
+    v[0] = (Vertex){a.x, a.y, color};
+    v[1] = (Vertex){b.x, b.y, color};
+}
 
-            float xr = x * cosA - y * sinA;
-            float yr = x * sinA + y * cosA;
+void drawEllipse(Body *body)
+{
+    if (body->type != SHAPE_ELLIPSE)
+        return;
 
-            verts[2 * i] = center.x + xr;
-            verts[2 * i + 1] = center.y + yr;
-        }
+    EllipseBatch *batch = body->filled ? &filledEllipses : &outlinedEllipses;
 
-        glBindVertexArray(VAO_global);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_global);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(0);
-        glDrawArrays(GL_LINE_LOOP, 0, steps + 1);
+    if (batch->count >= batch->capacity)
+    {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 256;
+        batch->instances = realloc(batch->instances, sizeof(EllipseInstance) * batch->capacity);
     }
+
+    Transform xf = getTransform(body);
+    batch->instances[batch->count++] = (EllipseInstance){
+        xf.position, body->data.ellipse.r, xf.cosRotation, xf.sinRotation, body->color};
 }
 
 void drawLine(Body *body)
 {
-    if (body->type != SHAPE_LINE || body_count >= MAX_SHAPES)
+    if (body->type != SHAPE_LINE)
         return;
 
-    float v[] = {body->data.line.vertices[0].x, body->data.line.vertices[0].y, body->data.line.vertices[1].x, body->data.line.vertices[1].y};
-
-    setColor(body->color);
-
-    glBindVertexArray(VAO_global);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_global);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(v), v, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0);
-    glEnableVertexAttribArray(0);
-    glDrawArrays(GL_LINES, 0, 2);
+    pushSegment(worldVertex(body, 0), worldVertex(body, 1), body->color);
 }
 
 void drawPolygon(Body *body)
 {
-    if (body->type != SHAPE_POLYGON || body_count >= MAX_SHAPES)
+    if (body->type != SHAPE_POLYGON)
         return;
 
     int numVertices = body->data.polygon.numVertices;
-    Vec2 *vertices = body->data.polygon.vertices;
+    Vec2 first = worldVertex(body, 0);
+    Vec2 previous = first;
 
-    float *v = (float *)malloc(numVertices * 2 * sizeof(float));
-
-    for (int i = 0; i < numVertices; i++)
+    for (int i = 1; i <= numVertices; i++)
     {
-        v[i * 2] = vertices[i].x;
-        v[i * 2 + 1] = vertices[i].y;
-    }
-
-    setColor(body->color);
+        Vec2 vertex = i < numVertices ? worldVertex(body, i) : first;
 
-    if (body->filled)
-    {
-        glBindVertexArray(VAO_global);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_global);
-        glBufferData(GL_ARRAY_BUFFER, numVertices * 2 * sizeof(float), v, GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
-        glEnableVertexAttribArray(0);
-
-        if (numVertices == 3)
-            glDrawArrays(GL_TRIANGLES, 0, 3);
+        // Same fan around the first vertex that GL_TRIANGLE_FAN would build
+        if (body->filled)
+        {
+            if (i < numVertices - 1)
+                pushTriangle(first, vertex, worldVertex(body, i + 1), body->color);
+        }
         else
-            glDrawArrays(GL_TRIANGLE_FAN, 0, numVertices);
-    }
-    else
-    {
-        glBindVertexArray(VAO_global);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO_global);
-        glBufferData(GL_ARRAY_BUFFER, numVertices * 2 * sizeof(float), v, GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
-        glEnableVertexAttribArray(0);
+        {
+            pushSegment(previous, vertex, body->color);
+        }
 
-        glDrawArrays(GL_LINE_LOOP, 0, numVertices);
+        previous = vertex;
     }
-
-    free(v);
 }
 
 void draw(Body *body)
@@ -182,20 +229,68 @@ void drawAllShapes()
 {
     for (int i = 0; i < body_count; i++)
     {
-        Body *a = &bodies[i];
-        switch (a->type)
-        {
-        case SHAPE_LINE:
-            drawLine(&bodies[i]);
-            break;
-        case SHAPE_POLYGON:
-            drawPolygon(&bodies[i]);
-            break;
-        case SHAPE_ELLIPSE:
-            drawEllipse(&bodies[i]);
-            break;
-        default:
-            break;
-        }
+        draw(bodyAt(i));
     }
-}
\ No newline at end of file
+}
+
+// Uploads everything queued since the last flush in one go per buffer and
+// draws it: fills first, then outlines on top
+void flushDraw(void)
+{
+    int total = triangles.count + lines.count;
+    int ellipses = filledEllipses.count + outlinedEllipses.count;
+
+    if (total > 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_global);
+
+        // Orphan last frame's storage so the driver never waits for it
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * total, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * triangles.count, triangles.vertices);
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(Vertex) * triangles.count, sizeof(Vertex) * lines.count, lines.vertices);
+    }
+
+    if (ellipses > 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, ellipseInstanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(EllipseInstance) * ellipses, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(EllipseInstance) * filledEllipses.count, filledEllipses.instances);
+        glBufferSubData(GL_ARRAY_BUFFER, sizeof(EllipseInstance) * filledEllipses.count,
+                        sizeof(EllipseInstance) * outlinedEllipses.count, outlinedEllipses.instances);
+    }
+
+    if (triangles.count > 0)
+    {
+        glUseProgram(shapeProgram_global);
+        glBindVertexArray(VAO_global);
+        glDrawArrays(GL_TRIANGLES, 0, triangles.count);
+    }
+
+    if (filledEllipses.count > 0)
+    {
+        glUseProgram(ellipseProgram_global);
+        glBindVertexArray(ellipseVAO);
+        bindEllipseInstances(0);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, ELLIPSE_SEGMENTS * 3, filledEllipses.count);
+    }
+
+    if (lines.count > 0)
+    {
+        glUseProgram(shapeProgram_global);
+        glBindVertexArray(VAO_global);
+        glDrawArrays(GL_LINES, triangles.count, lines.count);
+    }
+
+    if (outlinedEllipses.count > 0)
+    {
+        glUseProgram(ellipseProgram_global);
+        glBindVertexArray(ellipseVAO);
+        bindEllipseInstances(filledEllipses.count);
+        glDrawArraysInstanced(GL_LINES, ELLIPSE_SEGMENTS * 3, ELLIPSE_SEGMENTS * 2, outlinedEllipses.count);
+    }
+
+    triangles.count = 0;
+    lines.count = 0;
+    filledEllipses.count = 0;
+    outlinedEllipses.count = 0;
+}
@@ -16,11 +16,10 @@ int calculateFPS(double currentTime)
     {
         currentFPS = frameCount / (currentTime - lastTime);
 
-        return (int)currentFPS;
-        
         frameCount = 0;
         lastTime = currentTime;
-
     }
-    return 0;
+
+    // Last full second's average, so callers can show it every frame
+    return (int)currentFPS;
 }
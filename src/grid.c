@@ -0,0 +1,204 @@
+#include "grid.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Cell coordinates are clamped to this, so bodies absurdly far away share
+// the outermost cells instead of overflowing
+#define GRID_COORDINATE_LIMIT 1073741824.0f
+
+static float extent(AABB box)
+{
+    return fmaxf(box.max.x - box.min.x, box.max.y - box.min.y);
+}
+
+static int cellCoordinate(float v, float cellSize)
+{
+    float cell = floorf(v / cellSize);
+    return (int)fmaxf(fminf(cell, GRID_COORDINATE_LIMIT), -GRID_COORDINATE_LIMIT);
+}
+
+static int bucketOf(SpatialGrid *grid, int x, int y)
+{
+    unsigned hash = (unsigned)x * 73856093u ^ (unsigned)y * 19349663u;
+    return (int)(hash & (unsigned)(grid->bucketCount - 1));
+}
+
+void grid_build(SpatialGrid *grid, int count, AABB *bounds, float cellSize)
+{
+    if (grid->bodyCapacity < count)
+    {
+        grid->bodyCapacity = count * 2;
+        grid->slotBody = realloc(grid->slotBody, sizeof(int) * grid->bodyCapacity);
+        grid->slotX = realloc(grid->slotX, sizeof(int) * grid->bodyCapacity);
+        grid->slotY = realloc(grid->slotY, sizeof(int) * grid->bodyCapacity);
+        grid->large = realloc(grid->large, sizeof(int) * grid->bodyCapacity);
+        grid->bodyBucket = realloc(grid->bodyBucket, sizeof(int) * grid->bodyCapacity);
+        grid->bodyX = realloc(grid->bodyX, sizeof(int) * grid->bodyCapacity);
+        grid->bodyY = realloc(grid->bodyY, sizeof(int) * grid->bodyCapacity);
+    }
+
+    if (cellSize <= 0.0f)
+    {
+        cellSize = 0.0f;
+        for (int i = 0; i < count; i++)
+        {
+            if (bodyState.flags[i] & BODY_DYNAMIC)
+                cellSize = fmaxf(cellSize, extent(bounds[i]));
+        }
+
+        // Nothing moves, so nothing will query; any size will do
+        if (cellSize <= 0.0f)
+            cellSize = 1.0f;
+    }
+
+    // About two buckets per body keeps cells from sharing buckets often
+    int buckets = 64;
+    while (buckets < count * 2)
+        buckets *= 2;
+
+    // Two extra entries for the counting sort below
+    if (grid->bucketCapacity < buckets + 2)
+    {
+        grid->bucketCapacity = buckets + 2;
+        grid->bucketStart = realloc(grid->bucketStart, sizeof(int) * grid->bucketCapacity);
+    }
+    memset(grid->bucketStart, 0, sizeof(int) * (buckets + 2));
+
+    grid->bounds = bounds;
+    grid->cellSize = cellSize;
+    grid->bucketCount = buckets;
+    grid->largeCount = 0;
+
+    // Counting sort into buckets: count each bucket in bucketStart[b + 2],
+    // turn the counts into offsets so that bucketStart[b + 1] is where
+    // bucket b starts, then scatter while advancing bucketStart[b + 1] to
+    // the end of bucket b, which is exactly where bucket b + 1 starts
+    for (int i = 0; i < count; i++)
+    {
+        if (extent(bounds[i]) > cellSize)
+        {
+            grid->bodyBucket[i] = -1;
+            grid->large[grid->largeCount++] = i;
+            continue;
+        }
+
+        int x = cellCoordinate((bounds[i].min.x + bounds[i].max.x) * 0.5f, cellSize);
+        int y = cellCoordinate((bounds[i].min.y + bounds[i].max.y) * 0.5f, cellSize);
+        int bucket = bucketOf(grid, x, y);
+
+        grid->bodyX[i] = x;
+        grid->bodyY[i] = y;
+        grid->bodyBucket[i] = bucket;
+        grid->bucketStart[bucket + 2]++;
+    }
+
+    for (int b = 2; b < buckets + 2; b++)
+        grid->bucketStart[b] += grid->bucketStart[b - 1];
+
+    for (int i = 0; i < count; i++)
+    {
+        int bucket = grid->bodyBucket[i];
+        if (bucket < 0)
+            continue;
+
+        int slot = grid->bucketStart[bucket + 1]++;
+        grid->slotBody[slot] = i;
+        grid->slotX[slot] = grid->bodyX[i];
+        grid->slotY[slot] = grid->bodyY[i];
+    }
+
+    grid->slotCount = count - grid->largeCount;
+}
+
+// Appends a body to a query result; false once `out` is full
+static bool emit(Body **out, int *count, int maxCount, int body, bool *truncated)
+{
+    if (*count == maxCount)
+    {
+        if (truncated)
+            *truncated = true;
+        return false;
+    }
+
+    out[(*count)++] = bodyAt(body);
+    return true;
+}
+
+int grid_query(SpatialGrid *grid, AABB box, Body **out, int maxCount, bool *truncated)
+{
+    int count = 0;
+
+    if (truncated)
+        *truncated = false;
+
+    if (grid->slotCount > 0)
+    {
+        // A body in a cell is at most a cell wide, so its center is within
+        // half a cell of any box it overlaps
+        float half = grid->cellSize * 0.5f;
+        int x0 = cellCoordinate(box.min.x - half, grid->cellSize);
+        int x1 = cellCoordinate(box.max.x + half, grid->cellSize);
+        int y0 = cellCoordinate(box.min.y - half, grid->cellSize);
+        int y1 = cellCoordinate(box.max.y + half, grid->cellSize);
+
+        float cells = ((float)x1 - (float)x0 + 1.0f) * ((float)y1 - (float)y0 + 1.0f);
+
+        if (cells > (float)grid->bucketCount)
+        {
+            // Boxes covering more cells than there are buckets are cheaper
+            // to answer by looking at every body once
+            for (int k = 0; k < grid->slotCount; k++)
+            {
+                int body = grid->slotBody[k];
+                if (aabb_overlap(grid->bounds[body], box) && !emit(out, &count, maxCount, body, truncated))
+                    return count;
+            }
+        }
+        else
+        {
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    int bucket = bucketOf(grid, x, y);
+                    int end = grid->bucketStart[bucket + 1];
+
+                    for (int k = grid->bucketStart[bucket]; k < end; k++)
+                    {
+                        // Skip bodies of other cells hashed to this bucket,
+                        // they are found when their own cell is scanned
+                        if (grid->slotX[k] != x || grid->slotY[k] != y)
+                            continue;
+
+                        int body = grid->slotBody[k];
+                        if (aabb_overlap(grid->bounds[body], box) && !emit(out, &count, maxCount, body, truncated))
+                            return count;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int k = 0; k < grid->largeCount; k++)
+    {
+        int body = grid->large[k];
+        if (aabb_overlap(grid->bounds[body], box) && !emit(out, &count, maxCount, body, truncated))
+            return count;
+    }
+
+    return count;
+}
+
+void grid_free(SpatialGrid *grid)
+{
+    free(grid->bucketStart);
+    free(grid->slotBody);
+    free(grid->slotX);
+    free(grid->slotY);
+    free(grid->large);
+    free(grid->bodyBucket);
+    free(grid->bodyX);
+    free(grid->bodyY);
+    *grid = (SpatialGrid){0};
+}
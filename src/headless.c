@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "init_shapes.h"
+#include "world.h"
+#include "profiler.h"
+#include "circlebatch.h"
+#include "jobs.h"
+
+// Runs the demo scene without a window and reports raw step throughput
+// followed by the per-phase profile of the last PROFILER_WINDOW steps.
+// Usage: headless [ellipses] [steps] [threads] [tree|kd|grid|sap] [circle lanes]
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    int ellipseCount = argc > 1 ? atoi(argv[1]) : 50;
+    int steps = argc > 2 ? atoi(argv[2]) : 1000;
+
+    WorldConfig config = world_default_config();
+    config.threadCount = argc > 3 ? atoi(argv[3]) : 0;
+    if (argc > 4 && strcmp(argv[4], "kd") == 0)
+        config.broadphase = BROADPHASE_KDTREE;
+    if (argc > 4 && strcmp(argv[4], "grid") == 0)
+        config.broadphase = BROADPHASE_GRID;
+    if (argc > 4 && strcmp(argv[4], "sap") == 0)
+        config.broadphase = BROADPHASE_SAP;
+    config.circleLanes = argc > 5 ? atoi(argv[5]) : 0;
+    world_init(config);
+
+    for (int i = 0; i < ellipseCount; i++)
+    {
+        Vec2 pos = {(float)(rand() % 200 - 100) / 100.0f,
+                    (float)(rand() % 200 - 100) / 100.0f};
+        Vec2 radius = {0.025f, 0.025f};
+
+        Body *b = init_ellipse(pos, radius, COLOR_RED);
+        b->filled = i % 2 == 0;
+        setDynamic(b, true);
+    }
+
+    Body *polygon1 = init_polygon((Vec2[]){{-0.5f, -0.5f}, {0.5f, -0.5f}, {0.5f, 0.5f}, {0.0f, 0.25f}, {-0.5f, 0.5f}}, 5, COLOR_BLUE);
+    polygon1->filled = true;
+
+    init_polygon((Vec2[]){{0.6f, -0.3f}, {0.9f, -0.3f}, {0.75f, 0.2f}}, 3, COLOR_GREEN);
+    init_line((Vec2){-0.8f, -0.8f}, (Vec2){-0.6f, 0.8f}, COLOR_CYAN);
+    init_line((Vec2){0.6f, 0.6f}, (Vec2){0.9f, 0.9f}, COLOR_MAGENTA);
+
+    double start = now();
+
+    for (int i = 0; i < steps; i++)
+    {
+        world_step(1.0f / 60.0f);
+        profiler_frame_end();
+    }
+
+    double elapsed = now() - start;
+
+    int sleeping = 0;
+    for (int i = 0; i < body_count; i++)
+    {
+        if (isSleeping(bodyAt(i)))
+            sleeping++;
+    }
+
+    printf("bodies: %d (%d sleeping)\n", body_count, sleeping);
+    printf("threads: %d\n", jobs_thread_count());
+    printf("circle lanes: %d\n", circlebatch_lanes());
+    printf("steps: %d in %.3f s\n", steps, elapsed);
+    printf("steps/s: %.1f\n", elapsed > 0.0 ? steps / elapsed : 0.0);
+    profiler_print(stdout);
+
+    EPAStats epa = getEPAStats();
+    if (epa.runs > 0)
+    {
+        printf("epa: %d runs, %.1f iterations avg, %d max, %d truncated\n",
+               epa.runs, (double)epa.iterations / epa.runs, epa.maxIterations, epa.truncated);
+    }
+
+    world_shutdown();
+    return 0;
+}
@@ -1,115 +1,308 @@
 #include "init_shapes.h"
 #include <math.h>
 #include <stdlib.h>
-#include "draw_shapes.h"
+#include <string.h>
 
 int body_count;
-Body bodies[MAX_SHAPES];
+Body **bodyPages;
+BodyState bodyState;
 
-Body *init_ellipse(Vec2 pos, Vec2 r, Color color)
+static int pageCount;
+static int stateCapacity;
+
+// Moves a hot array into a larger 64 byte aligned block
+static void *growArray(void *old, size_t elementSize, int count, int capacity)
 {
-    Body *object = 0;
-    if (body_count < MAX_SHAPES)
+    void *array = aligned_alloc(64, elementSize * capacity);
+    if (count > 0)
+        memcpy(array, old, elementSize * count);
+
+    free(old);
+    return array;
+}
+
+// Pages are added one at a time and never move; the hot arrays double
+static void reserveBodies(int count)
+{
+    if (count > pageCount * BODY_PAGE_SIZE)
+    {
+        bodyPages = realloc(bodyPages, sizeof(Body *) * (pageCount + 1));
+        bodyPages[pageCount++] = malloc(sizeof(Body) * BODY_PAGE_SIZE);
+    }
+
+    if (count > stateCapacity)
     {
-        object = &bodies[body_count++];
-
-        object->id = body_count;
-        object->type = SHAPE_ELLIPSE;
-        object->filled = false;
-        object->color = color;
-        object->acceleration = (Vec2){0.0f, 0.0f};
-        object->velocity = (Vec2){0.0f, 0.0f};
-        object->mass = 0.0f;
-        object->restitution = 0.8f;
-        object->friction = 0.3f;
-        object->isDynamic = false;
-        object->data.ellipse.r = r;
-        object->data.ellipse.pos = pos;
+        // Always a multiple of the page size, which keeps every array size a
+        // multiple of the alignment as aligned_alloc() requires
+        int capacity = stateCapacity ? stateCapacity * 2 : BODY_PAGE_SIZE;
+        BodyState *s = &bodyState;
+
+        s->positionX = growArray(s->positionX, sizeof(float), body_count, capacity);
+        s->positionY = growArray(s->positionY, sizeof(float), body_count, capacity);
+        s->rotation = growArray(s->rotation, sizeof(float), body_count, capacity);
+        s->cosRotation = growArray(s->cosRotation, sizeof(float), body_count, capacity);
+        s->sinRotation = growArray(s->sinRotation, sizeof(float), body_count, capacity);
+        s->velocityX = growArray(s->velocityX, sizeof(float), body_count, capacity);
+        s->velocityY = growArray(s->velocityY, sizeof(float), body_count, capacity);
+        s->inverseMass = growArray(s->inverseMass, sizeof(float), body_count, capacity);
+        s->sleepTime = growArray(s->sleepTime, sizeof(float), body_count, capacity);
+        s->proxy = growArray(s->proxy, sizeof(int), body_count, capacity);
+        s->flags = growArray(s->flags, sizeof(unsigned char), body_count, capacity);
+
+        stateCapacity = capacity;
     }
+}
+
+// Takes the next free slot and resets both its cold record and its hot state
+static Body *newBody(ShapeType type, Color color, Vec2 position)
+{
+    reserveBodies(body_count + 1);
+
+    static int nextId = 0;
+
+    int i = body_count++;
+    Body *object = bodyAt(i);
+
+    object->id = ++nextId;
+    object->index = i;
+    object->type = type;
+    object->filled = false;
+    object->color = color;
+    object->mass = 0.0f;
+    object->restitution = 0.8f;
+    object->friction = 0.3f;
+
+    bodyState.positionX[i] = position.x;
+    bodyState.positionY[i] = position.y;
+    bodyState.velocityX[i] = 0.0f;
+    bodyState.velocityY[i] = 0.0f;
+    bodyState.inverseMass[i] = 0.0f;
+    bodyState.sleepTime[i] = 0.0f;
+    bodyState.proxy[i] = -1;
+    bodyState.flags[i] = 0;
+    setRotation(object, 0.0f);
+
+    return object;
+}
+
+Body *init_ellipse(Vec2 pos, Vec2 r, Color color)
+{
+    Body *object = newBody(SHAPE_ELLIPSE, color, pos);
+    object->data.ellipse.r = r;
+    bodyState.flags[object->index] |= BODY_BOUNDED;
 
     return object;
 }
 
 Body *init_line(Vec2 a, Vec2 b, Color color)
 {
-    Body *object = 0;
-    if (body_count < MAX_SHAPES)
-    {
-        object = &bodies[body_count++];
-
-        object->id = body_count;
-        object->type = SHAPE_LINE;
-        object->color = color;
-        object->acceleration = (Vec2){0.0f, 0.0f};
-        object->velocity = (Vec2){0.0f, 0.0f};
-        object->mass = 0.0f;
-        object->restitution = 0.8f;
-        object->friction = 0.3f;
-        object->isDynamic = false;
-        object->data.line.vertices[0] = a;
-        object->data.line.vertices[1] = b;
-    }
+    // Endpoints are stored relative to the midpoint
+    Vec2 center = {(a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f};
+
+    Body *object = newBody(SHAPE_LINE, color, center);
+    object->data.line.vertices[0] = vec_sub(a, center);
+    object->data.line.vertices[1] = vec_sub(b, center);
 
     return object;
 }
 
 Body *init_polygon(Vec2 *vertices, int numVertices, Color color)
 {
-    Body *object = 0;
-    if (body_count < MAX_SHAPES)
+    // Vertices are stored relative to their average, which is also the
+    // point the polygon rotates around
+    Vec2 center = {0.0f, 0.0f};
+    for (int i = 0; i < numVertices; i++)
     {
-        object = &bodies[body_count++];
-
-        object->id = body_count;
-        object->type = SHAPE_POLYGON;
-        object->filled = false;
-        object->color = color;
-        object->acceleration = (Vec2){0.0f, 0.0f};
-        object->velocity = (Vec2){0.0f, 0.0f};
-        object->mass = 0.0f;
-        object->restitution = 0.8f;
-        object->friction = 0.3f;
-        object->isDynamic = false;
-        object->data.polygon.numVertices = numVertices;
-        object->data.polygon.vertices = malloc(sizeof(Vec2) * numVertices);
-
-        for (int i = 0; i < numVertices; i++)
-        {
-            object->data.polygon.vertices[i] = vertices[i];
-        }
+        center.x += vertices[i].x;
+        center.y += vertices[i].y;
+    }
+    center.x /= numVertices;
+    center.y /= numVertices;
+
+    Body *object = newBody(SHAPE_POLYGON, color, center);
+    object->data.polygon.numVertices = numVertices;
+    object->data.polygon.vertices = malloc(sizeof(Vec2) * numVertices);
+    object->data.polygon.decomposed = false;
+    object->data.polygon.parts = NULL;
+    object->data.polygon.partOffsets = NULL;
+    object->data.polygon.partCount = 0;
+    object->data.polygon.normalAngles = NULL;
+
+    for (int i = 0; i < numVertices; i++)
+    {
+        object->data.polygon.vertices[i] = vec_sub(vertices[i], center);
     }
 
+    object->data.polygon.normals = malloc(sizeof(Vec2) * numVertices);
+    computeEdgeNormals(object->data.polygon.vertices, numVertices, object->data.polygon.normals);
+
     return object;
 }
 
 Vec2 findCenter(Body *body)
 {
+    return getPosition(body);
+}
+
+AABB findBounds(Body *body)
+{
+    Transform xf = getTransform(body);
+
     if (body->type == SHAPE_POLYGON)
     {
-        Vec2 center = {0.0f, 0.0f};
-        for (int i = 0; i < body->data.polygon.numVertices; i++)
+        Vec2 first = tf_point(xf, body->data.polygon.vertices[0]);
+        AABB box = {first, first};
+        for (int i = 1; i < body->data.polygon.numVertices; i++)
         {
-            center.x += body->data.polygon.vertices[i].x;
-            center.y += body->data.polygon.vertices[i].y;
+            Vec2 v = tf_point(xf, body->data.polygon.vertices[i]);
+            box.min.x = fminf(box.min.x, v.x);
+            box.min.y = fminf(box.min.y, v.y);
+            box.max.x = fmaxf(box.max.x, v.x);
+            box.max.y = fmaxf(box.max.y, v.y);
         }
-
-        center.x /= body->data.polygon.numVertices;
-        center.y /= body->data.polygon.numVertices;
-
-        return center;
+        return box;
     }
     if (body->type == SHAPE_ELLIPSE)
     {
-        return body->data.ellipse.pos;
+        // Half extents of a rotated ellipse
+        float cosA = xf.cosRotation;
+        float sinA = xf.sinRotation;
+        float rx = body->data.ellipse.r.x;
+        float ry = body->data.ellipse.r.y;
+        float hx = sqrtf(rx * rx * cosA * cosA + ry * ry * sinA * sinA);
+        float hy = sqrtf(rx * rx * sinA * sinA + ry * ry * cosA * cosA);
+        Vec2 pos = xf.position;
+        return (AABB){{pos.x - hx, pos.y - hy}, {pos.x + hx, pos.y + hy}};
     }
     if (body->type == SHAPE_LINE)
     {
-        Vec2 A = body->data.line.vertices[0];
-        Vec2 B = body->data.line.vertices[1];
-        return (Vec2){(A.x + B.x) * 0.5f, (A.y + B.y) * 0.5f};
+        Vec2 A = tf_point(xf, body->data.line.vertices[0]);
+        Vec2 B = tf_point(xf, body->data.line.vertices[1]);
+        return (AABB){{fminf(A.x, B.x), fminf(A.y, B.y)}, {fmaxf(A.x, B.x), fmaxf(A.y, B.y)}};
+    }
+
+    return (AABB){{0.0f, 0.0f}, {0.0f, 0.0f}};
+}
+
+Transform getTransform(Body *body)
+{
+    int i = body->index;
+    return (Transform){{bodyState.positionX[i], bodyState.positionY[i]}, bodyState.cosRotation[i], bodyState.sinRotation[i]};
+}
+
+Vec2 getPosition(Body *body)
+{
+    return (Vec2){bodyState.positionX[body->index], bodyState.positionY[body->index]};
+}
+
+void setPosition(Body *body, Vec2 position)
+{
+    bodyState.positionX[body->index] = position.x;
+    bodyState.positionY[body->index] = position.y;
+    bodyState.flags[body->index] |= BODY_MOVED;
+}
+
+float getRotation(Body *body)
+{
+    return bodyState.rotation[body->index];
+}
+
+void setRotation(Body *body, float angle)
+{
+    bodyState.rotation[body->index] = angle;
+    bodyState.cosRotation[body->index] = cosf(angle);
+    bodyState.sinRotation[body->index] = sinf(angle);
+    bodyState.flags[body->index] |= BODY_MOVED;
+}
+
+Vec2 getVelocity(Body *body)
+{
+    return (Vec2){bodyState.velocityX[body->index], bodyState.velocityY[body->index]};
+}
+
+void setVelocity(Body *body, Vec2 velocity)
+{
+    bodyState.velocityX[body->index] = velocity.x;
+    bodyState.velocityY[body->index] = velocity.y;
+}
+
+// Bodies without a mass are treated as unit mass
+static float dynamicInverseMass(Body *body)
+{
+    return body->mass > 0.0f ? 1.0f / body->mass : 1.0f;
+}
+
+void setMass(Body *body, float mass)
+{
+    body->mass = mass;
+    if (isDynamic(body))
+        bodyState.inverseMass[body->index] = dynamicInverseMass(body);
+}
+
+void setDynamic(Body *body, bool dynamic)
+{
+    int i = body->index;
+
+    if (dynamic)
+    {
+        bodyState.flags[i] |= BODY_DYNAMIC;
+        bodyState.inverseMass[i] = dynamicInverseMass(body);
     }
+    else
+    {
+        bodyState.flags[i] &= ~(BODY_DYNAMIC | BODY_SLEEPING);
+        bodyState.inverseMass[i] = 0.0f;
+    }
+}
 
-    return (Vec2){0.0f, 0.0f};
+bool isDynamic(Body *body)
+{
+    return bodyState.flags[body->index] & BODY_DYNAMIC;
+}
+
+void setBullet(Body *body, bool bullet)
+{
+    if (bullet)
+        bodyState.flags[body->index] |= BODY_BULLET;
+    else
+        bodyState.flags[body->index] &= ~BODY_BULLET;
+}
+
+bool isBullet(Body *body)
+{
+    return bodyState.flags[body->index] & BODY_BULLET;
+}
+
+bool isSleeping(Body *body)
+{
+    return bodyState.flags[body->index] & BODY_SLEEPING;
+}
+
+// Dynamic and not asleep, i.e. the body is integrated and drives collision checks
+bool isAwake(Body *body)
+{
+    return BODY_AWAKE(bodyState.flags[body->index]);
+}
+
+Vec2 toWorld(Body *body, Vec2 local)
+{
+    return tf_point(getTransform(body), local);
+}
+
+Vec2 toLocal(Body *body, Vec2 world)
+{
+    return tf_invPoint(getTransform(body), world);
+}
+
+// World position of a polygon vertex or line endpoint
+Vec2 worldVertex(Body *body, int index)
+{
+    if (body->type == SHAPE_POLYGON)
+        return toWorld(body, body->data.polygon.vertices[index]);
+    if (body->type == SHAPE_LINE)
+        return toWorld(body, body->data.line.vertices[index]);
+
+    return getPosition(body);
 }
 
 bool removeBody(Body *body)
@@ -117,25 +310,84 @@ bool removeBody(Body *body)
     if (!body || body_count == 0)
         return false;
 
-    int index = body - bodies; // pointer → index
+    int index = body->index;
 
-    if (index < 0 || index >= body_count)
+    if (index < 0 || index >= body_count || bodyAt(index) != body)
         return false;
 
     // Free internal allocations
     if (body->type == SHAPE_POLYGON)
+    {
+        invalidateDecomposition(body);
         free(body->data.polygon.vertices);
+        free(body->data.polygon.normals);
+    }
 
-    // Move last body into this slot
-    bodies[index] = bodies[body_count - 1];
+    // Move last body into this slot, hot state included
+    int last = body_count - 1;
+    *body = *bodyAt(last);
+    body->index = index;
+
+    bodyState.positionX[index] = bodyState.positionX[last];
+    bodyState.positionY[index] = bodyState.positionY[last];
+    bodyState.rotation[index] = bodyState.rotation[last];
+    bodyState.cosRotation[index] = bodyState.cosRotation[last];
+    bodyState.sinRotation[index] = bodyState.sinRotation[last];
+    bodyState.velocityX[index] = bodyState.velocityX[last];
+    bodyState.velocityY[index] = bodyState.velocityY[last];
+    bodyState.inverseMass[index] = bodyState.inverseMass[last];
+    bodyState.sleepTime[index] = bodyState.sleepTime[last];
+    bodyState.proxy[index] = bodyState.proxy[last];
+    bodyState.flags[index] = bodyState.flags[last];
+
+    // Its broadphase proxy still refers to the old slot
+    bodyState.flags[index] |= BODY_MOVED;
 
     body_count--;
     return true;
 }
 
-void decompose(Body *body, Body **triangles, int *triangle_count)
+void invalidateDecomposition(Body *body)
+{
+    if (body->type != SHAPE_POLYGON)
+        return;
+
+    if (body->data.polygon.partCount > 0)
+    {
+        free(body->data.polygon.parts[0].data.polygon.vertices);
+        free(body->data.polygon.parts[0].data.polygon.normals);
+    }
+
+    free(body->data.polygon.parts);
+    free(body->data.polygon.partOffsets);
+    free(body->data.polygon.normalAngles);
+    body->data.polygon.parts = NULL;
+    body->data.polygon.partOffsets = NULL;
+    body->data.polygon.normalAngles = NULL;
+    body->data.polygon.partCount = 0;
+    body->data.polygon.decomposed = false;
+}
+
+// Works for either winding order
+void computeEdgeNormals(Vec2 *vertices, int numVertices, Vec2 *normals)
+{
+    float area = 0.0f;
+    for (int i = 0; i < numVertices; i++)
+        area += vec_cross(vertices[i], vertices[(i + 1) % numVertices]);
+
+    float side = area < 0.0f ? -1.0f : 1.0f;
+
+    for (int i = 0; i < numVertices; i++)
+    {
+        Vec2 e = vec_sub(vertices[(i + 1) % numVertices], vertices[i]);
+        normals[i] = vec_normalize((Vec2){e.y * side, -e.x * side});
+    }
+}
+
+// Ear clipping; writes 3 vertex indices per triangle into `triangles`,
+// which must hold (numVertices - 2) * 3 ints
+void decompose(Body *body, int *triangles, int *triangle_count)
 {
-    // Body *triangles[body->data.polygon.numVertices - 2];
     *triangle_count = 0;
 
     // Create a list of remaining vertex indices
@@ -212,14 +464,9 @@ void decompose(Body *body, Body **triangles, int *triangle_count)
             if (is_ear)
             {
                 // Create triangle
-                triangles[*triangle_count] = malloc(sizeof(Body));
-                triangles[*triangle_count]->type = SHAPE_POLYGON;
-                triangles[*triangle_count]->color = COLOR_RED;
-                triangles[*triangle_count]->data.polygon.vertices = malloc(3 * sizeof(Vec2));
-                triangles[*triangle_count]->data.polygon.vertices[0] = va;
-                triangles[*triangle_count]->data.polygon.vertices[1] = vb;
-                triangles[*triangle_count]->data.polygon.vertices[2] = vc;
-                triangles[*triangle_count]->data.polygon.numVertices = 3;
+                triangles[*triangle_count * 3] = a;
+                triangles[*triangle_count * 3 + 1] = b;
+                triangles[*triangle_count * 3 + 2] = c;
                 (*triangle_count)++;
 
                 // Remove vertex b from remaining list
@@ -244,14 +491,9 @@ void decompose(Body *body, Body **triangles, int *triangle_count)
     // Add the final triangle
     if (num_remaining == 3)
     {
-        triangles[*triangle_count] = malloc(sizeof(Body));
-        triangles[*triangle_count]->type = SHAPE_POLYGON;
-        triangles[*triangle_count]->color = COLOR_RED;
-        triangles[*triangle_count]->data.polygon.vertices = malloc(3 * sizeof(Vec2));
-        triangles[*triangle_count]->data.polygon.vertices[0] = body->data.polygon.vertices[remaining[0]];
-        triangles[*triangle_count]->data.polygon.vertices[1] = body->data.polygon.vertices[remaining[1]];
-        triangles[*triangle_count]->data.polygon.vertices[2] = body->data.polygon.vertices[remaining[2]];
-        triangles[*triangle_count]->data.polygon.numVertices = 3;
+        triangles[*triangle_count * 3] = remaining[0];
+        triangles[*triangle_count * 3 + 1] = remaining[1];
+        triangles[*triangle_count * 3 + 2] = remaining[2];
         (*triangle_count)++;
     }
 }
@@ -277,11 +519,11 @@ bool pointInPolygon(Vec2 point, Vec2 *vertices, int numVertices)
 // Check if a point is inside an ellipse
 bool pointInEllipse(Vec2 point, Body *ellipse)
 {
-    Vec2 center = ellipse->data.ellipse.pos;
+    Vec2 local = toLocal(ellipse, point);
     Vec2 r = ellipse->data.ellipse.r;
 
-    float dx = (point.x - center.x) / r.x;
-    float dy = (point.y - center.y) / r.y;
+    float dx = local.x / r.x;
+    float dy = local.y / r.y;
 
     return (dx * dx + dy * dy) <= 1.0f;
 }
@@ -292,7 +534,7 @@ bool isInsideShape(Body *a, Body *b)
 
     if (b->type == SHAPE_POLYGON)
     {
-        return pointInPolygon(centerA, b->data.polygon.vertices, b->data.polygon.numVertices);
+        return pointInPolygon(toLocal(b, centerA), b->data.polygon.vertices, b->data.polygon.numVertices);
     }
     else if (b->type == SHAPE_ELLIPSE)
     {
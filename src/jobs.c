@@ -0,0 +1,238 @@
+#include "jobs.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct
+{
+    JobRangeFn fn;
+    void *context;
+    int begin;
+    int end;
+} Job;
+
+// The owner pops from the tail, thieves take from the head
+typedef struct
+{
+    pthread_mutex_t lock;
+    Job *jobs;
+    int head;
+    int tail;
+    int capacity;
+} JobQueue;
+
+static JobQueue *queues;
+static pthread_t *threads;
+static int threadCount = 1;
+
+static atomic_int pending;
+
+static pthread_mutex_t wakeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeCond = PTHREAD_COND_INITIALIZER;
+static int generation;
+static bool quitting;
+
+static bool popJob(int self, Job *job)
+{
+    JobQueue *q = &queues[self];
+    bool found = false;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head)
+    {
+        *job = q->jobs[--q->tail];
+        found = true;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return found;
+}
+
+static bool stealJob(int self, Job *job)
+{
+    for (int i = 1; i < threadCount; i++)
+    {
+        JobQueue *q = &queues[(self + i) % threadCount];
+        bool found = false;
+
+        pthread_mutex_lock(&q->lock);
+        if (q->tail > q->head)
+        {
+            *job = q->jobs[q->head++];
+            found = true;
+        }
+        pthread_mutex_unlock(&q->lock);
+
+        if (found)
+            return true;
+    }
+
+    return false;
+}
+
+static void runJobs(int self)
+{
+    Job job;
+
+    while (atomic_load(&pending) > 0)
+    {
+        if (popJob(self, &job) || stealJob(self, &job))
+        {
+            job.fn(job.context, job.begin, job.end, self);
+            atomic_fetch_sub(&pending, 1);
+        }
+        else
+        {
+            // Remaining chunks are already running on other workers
+            sched_yield();
+        }
+    }
+}
+
+static void *workerMain(void *arg)
+{
+    int self = (int)(intptr_t)arg;
+    int seen = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&wakeLock);
+        while (generation == seen && !quitting)
+            pthread_cond_wait(&wakeCond, &wakeLock);
+
+        if (quitting)
+        {
+            pthread_mutex_unlock(&wakeLock);
+            return NULL;
+        }
+
+        seen = generation;
+        pthread_mutex_unlock(&wakeLock);
+
+        runJobs(self);
+    }
+}
+
+void jobs_init(int count)
+{
+    if (queues)
+        jobs_shutdown();
+
+    if (count <= 0)
+        count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+        count = 1;
+
+    threadCount = count;
+    quitting = false;
+    generation = 0;
+
+    queues = calloc(threadCount, sizeof(JobQueue));
+    for (int i = 0; i < threadCount; i++)
+        pthread_mutex_init(&queues[i].lock, NULL);
+
+    threads = malloc(sizeof(pthread_t) * threadCount);
+    for (int i = 1; i < threadCount; i++)
+        pthread_create(&threads[i], NULL, workerMain, (void *)(intptr_t)i);
+}
+
+void jobs_shutdown(void)
+{
+    if (!queues)
+        return;
+
+    pthread_mutex_lock(&wakeLock);
+    quitting = true;
+    pthread_cond_broadcast(&wakeCond);
+    pthread_mutex_unlock(&wakeLock);
+
+    for (int i = 1; i < threadCount; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        pthread_mutex_destroy(&queues[i].lock);
+        free(queues[i].jobs);
+    }
+
+    free(queues);
+    free(threads);
+    queues = NULL;
+    threads = NULL;
+    threadCount = 1;
+}
+
+int jobs_thread_count(void)
+{
+    return threadCount;
+}
+
+int jobs_chunk_count(int count, int grain)
+{
+    if (grain < 1)
+        grain = 1;
+
+    return (count + grain - 1) / grain;
+}
+
+void jobs_parallel_for(int count, int grain, JobRangeFn fn, void *context)
+{
+    if (count <= 0)
+        return;
+
+    if (grain < 1)
+        grain = 1;
+
+    int chunks = jobs_chunk_count(count, grain);
+
+    // Not worth waking anybody up
+    if (!queues || threadCount == 1 || chunks == 1)
+    {
+        for (int begin = 0; begin < count; begin += grain)
+            fn(context, begin, begin + grain < count ? begin + grain : count, 0);
+        return;
+    }
+
+    // Deal the chunks out round robin; every queue is empty between calls
+    for (int i = 0; i < threadCount; i++)
+    {
+        JobQueue *q = &queues[i];
+        int needed = chunks / threadCount + 1;
+
+        pthread_mutex_lock(&q->lock);
+        if (q->capacity < needed)
+        {
+            q->capacity = needed * 2;
+            q->jobs = realloc(q->jobs, sizeof(Job) * q->capacity);
+        }
+        q->head = 0;
+        q->tail = 0;
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    // Published before any chunk is visible: a worker still spinning from
+    // the previous call may pick one up right away
+    atomic_store(&pending, chunks);
+
+    for (int c = 0; c < chunks; c++)
+    {
+        JobQueue *q = &queues[c % threadCount];
+        int begin = c * grain;
+        int end = begin + grain < count ? begin + grain : count;
+
+        pthread_mutex_lock(&q->lock);
+        q->jobs[q->tail++] = (Job){fn, context, begin, end};
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    pthread_mutex_lock(&wakeLock);
+    generation++;
+    pthread_cond_broadcast(&wakeCond);
+    pthread_mutex_unlock(&wakeLock);
+
+    runJobs(0);
+}
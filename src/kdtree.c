@@ -1,62 +1,276 @@
 #include "kdtree.h"
+#include <math.h>
 
-KDNode *kd_insert(KDNode *node, Vec2 pos, Body *body, int depth)
+static float coordinate(int body, int axis)
 {
-    if (node == NULL)
+    return axis == 0 ? bodyState.positionX[body] : bodyState.positionY[body];
+}
+
+static void swapOrder(int *order, int a, int b)
+{
+    int t = order[a];
+    order[a] = order[b];
+    order[b] = t;
+}
+
+// Partially sorts order[lo, hi) along `axis` so that order[nth] is the body
+// a full sort would put there, with nothing larger before it and nothing
+// smaller after it (like std::nth_element)
+static void selectNth(int *order, int lo, int hi, int nth, int axis)
+{
+    while (hi - lo > 1)
     {
-        KDNode *newNode = malloc(sizeof(KDNode));
-        newNode->pos = pos;
-        newNode->body = body;
-        newNode->left = NULL;
-        newNode->right = NULL;
-        return newNode;
+        // Median of three as the pivot
+        float a = coordinate(order[lo], axis);
+        float b = coordinate(order[lo + (hi - lo) / 2], axis);
+        float c = coordinate(order[hi - 1], axis);
+        float pivot = fmaxf(fminf(a, b), fminf(fmaxf(a, b), c));
+
+        // Three-way partition, so runs of equal coordinates cannot make the
+        // selection quadratic
+        int lt = lo;
+        int i = lo;
+        int gt = hi;
+        while (i < gt)
+        {
+            float v = coordinate(order[i], axis);
+            if (v < pivot)
+                swapOrder(order, lt++, i++);
+            else if (v > pivot)
+                swapOrder(order, i, --gt);
+            else
+                i++;
+        }
+
+        if (nth < lt)
+            hi = lt;
+        else if (nth >= gt)
+            lo = gt;
+        else
+            return;
     }
+}
 
-    int axis = depth % 2;
+// Builds the subtree over order[lo, hi) and returns its node index. The
+// depth is log2 of the body count, so recursing here is fine.
+static int buildNode(KDTree *tree, AABB *bounds, int lo, int hi)
+{
+    if (lo >= hi)
+        return -1;
 
-    if ((axis == 0 && pos.x < node->pos.x) ||
-        (axis == 1 && pos.y < node->pos.y))
+    // Split along the axis the bodies are spread widest on
+    float minX = bodyState.positionX[tree->order[lo]];
+    float maxX = minX;
+    float minY = bodyState.positionY[tree->order[lo]];
+    float maxY = minY;
+    for (int i = lo + 1; i < hi; i++)
     {
-        node->left = kd_insert(node->left, pos, body, depth + 1);
+        int b = tree->order[i];
+        minX = fminf(minX, bodyState.positionX[b]);
+        maxX = fmaxf(maxX, bodyState.positionX[b]);
+        minY = fminf(minY, bodyState.positionY[b]);
+        maxY = fmaxf(maxY, bodyState.positionY[b]);
     }
-    else
+
+    int axis = maxX - minX >= maxY - minY ? 0 : 1;
+    int mid = lo + (hi - lo) / 2;
+    selectNth(tree->order, lo, hi, mid, axis);
+
+    int index = tree->count++;
+    int body = tree->order[mid];
+
+    int left = buildNode(tree, bounds, lo, mid);
+    int right = buildNode(tree, bounds, mid + 1, hi);
+
+    KDNode *node = &tree->nodes[index];
+    node->pos = (Vec2){bodyState.positionX[body], bodyState.positionY[body]};
+    node->body = bodyAt(body);
+    node->bounds = bounds[body];
+    node->subtree = bounds[body];
+    node->axis = axis;
+    node->left = left;
+    node->right = right;
+
+    if (left >= 0)
+        node->subtree = aabb_union(node->subtree, tree->nodes[left].subtree);
+    if (right >= 0)
+        node->subtree = aabb_union(node->subtree, tree->nodes[right].subtree);
+
+    return index;
+}
+
+void kd_build(KDTree *tree, int count, AABB *bounds)
+{
+    if (tree->capacity < count)
     {
-        node->right = kd_insert(node->right, pos, body, depth + 1);
+        tree->capacity = count * 2;
+        tree->nodes = realloc(tree->nodes, sizeof(KDNode) * tree->capacity);
+        tree->order = realloc(tree->order, sizeof(int) * tree->capacity);
     }
 
-    return node;
+    for (int i = 0; i < count; i++)
+        tree->order[i] = i;
+
+    tree->count = 0;
+    buildNode(tree, bounds, 0, count);
 }
 
-void kd_search_range(KDNode* node, Vec2 point, float radius, int depth, Body** out, int* count)
+// Depth-first traversal state. Depth is at most log2(2^31) + 1 for a tree
+// from kd_build(), and each pop pushes at most two children.
+#define KD_STACK_SIZE 64
+
+static float distanceSquared(AABB box, Vec2 point)
+{
+    float dx = fmaxf(fmaxf(box.min.x - point.x, point.x - box.max.x), 0.0f);
+    float dy = fmaxf(fmaxf(box.min.y - point.y, point.y - box.max.y), 0.0f);
+    return dx * dx + dy * dy;
+}
+
+int kd_query_aabb(KDTree *tree, AABB box, Body **out, int maxCount, bool *truncated)
 {
-    if (node == NULL) return;
+    int stack[KD_STACK_SIZE];
+    int top = 0;
+    int count = 0;
+
+    if (truncated)
+        *truncated = false;
 
-    float dx = node->pos.x - point.x;
-    float dy = node->pos.y - point.y;
-    float dist2 = dx*dx + dy*dy;
-    float r2 = radius * radius;
+    if (tree->count > 0)
+        stack[top++] = 0;
 
-    if (dist2 <= r2)
+    while (top > 0)
     {
-        out[*count] = node->body;
-        (*count)++;
+        KDNode *node = &tree->nodes[stack[--top]];
+
+        // Nothing below this node can overlap the box
+        if (!aabb_overlap(node->subtree, box))
+            continue;
+
+        if (aabb_overlap(node->bounds, box))
+        {
+            if (count == maxCount)
+            {
+                if (truncated)
+                    *truncated = true;
+                return count;
+            }
+            out[count++] = node->body;
+        }
+
+        // Right first so the left subtree is visited first
+        if (node->right >= 0)
+            stack[top++] = node->right;
+        if (node->left >= 0)
+            stack[top++] = node->left;
     }
 
-    int axis = depth % 2;
-    float delta = (axis == 0) ? dx : dy;
+    return count;
+}
 
-    if (delta > -radius)
-        kd_search_range(node->left, point, radius, depth + 1, out, count);
+int kd_query_radius(KDTree *tree, Vec2 point, float radius, Body **out, int maxCount, bool *truncated)
+{
+    int stack[KD_STACK_SIZE];
+    int top = 0;
+    int count = 0;
+    float radius2 = radius * radius;
 
-    if (delta < radius)
-        kd_search_range(node->right, point, radius, depth + 1, out, count);
+    if (truncated)
+        *truncated = false;
+
+    if (tree->count > 0)
+        stack[top++] = 0;
+
+    while (top > 0)
+    {
+        KDNode *node = &tree->nodes[stack[--top]];
+
+        if (distanceSquared(node->subtree, point) > radius2)
+            continue;
+
+        if (distanceSquared(node->bounds, point) <= radius2)
+        {
+            if (count == maxCount)
+            {
+                if (truncated)
+                    *truncated = true;
+                return count;
+            }
+            out[count++] = node->body;
+        }
+
+        if (node->right >= 0)
+            stack[top++] = node->right;
+        if (node->left >= 0)
+            stack[top++] = node->left;
+    }
+
+    return count;
 }
 
-void kd_free(KDNode* node)
+int kd_query_nearest(KDTree *tree, Vec2 point, int k, Body **out, float *distances)
 {
-    if (node == NULL) return;
+    int stack[KD_STACK_SIZE];
+    int top = 0;
+    int count = 0;
+
+    if (k <= 0)
+        return 0;
 
-    kd_free(node->left);
-    kd_free(node->right);
-    free(node);
-}
\ No newline at end of file
+    if (tree->count > 0)
+        stack[top++] = 0;
+
+    // out / distances hold the best bodies so far, sorted by squared
+    // distance until the very end
+    while (top > 0)
+    {
+        KDNode *node = &tree->nodes[stack[--top]];
+
+        if (count == k && distanceSquared(node->subtree, point) >= distances[k - 1])
+            continue;
+
+        float d = distanceSquared(node->bounds, point);
+        if (count < k || d < distances[k - 1])
+        {
+            int i = count < k ? count++ : k - 1;
+            while (i > 0 && distances[i - 1] > d)
+            {
+                out[i] = out[i - 1];
+                distances[i] = distances[i - 1];
+                i--;
+            }
+            out[i] = node->body;
+            distances[i] = d;
+        }
+
+        // Push the farther child first so the nearer one is searched first
+        // and tightens the cut-off sooner
+        int near = node->left;
+        int far = node->right;
+        if (near >= 0 && far >= 0 &&
+            distanceSquared(tree->nodes[far].subtree, point) < distanceSquared(tree->nodes[near].subtree, point))
+        {
+            near = node->right;
+            far = node->left;
+        }
+
+        if (far >= 0)
+            stack[top++] = far;
+        if (near >= 0)
+            stack[top++] = near;
+    }
+
+    for (int i = 0; i < count; i++)
+        distances[i] = sqrtf(distances[i]);
+
+    return count;
+}
+
+void kd_free(KDTree *tree)
+{
+    free(tree->nodes);
+    free(tree->order);
+    tree->nodes = NULL;
+    tree->order = NULL;
+    tree->count = 0;
+    tree->capacity = 0;
+}
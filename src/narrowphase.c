@@ -0,0 +1,433 @@
+#include "narrowphase.h"
+#include <math.h>
+#include <float.h>
+
+// How much further apart B's best edge must put the shapes than A's to be
+// picked as the reference edge
+#define REFERENCE_EDGE_TOLERANCE 1e-4f
+
+// Polygon or line seen as a closed loop of vertices with outward normals.
+// A line is a two sided loop whose normals point both ways.
+typedef struct
+{
+    Transform xf;
+    Vec2 *vertices;
+    Vec2 *normals;
+    int count;
+} ConvexView;
+
+static bool isCircle(Body *body)
+{
+    return body->type == SHAPE_ELLIPSE && body->data.ellipse.r.x == body->data.ellipse.r.y;
+}
+
+static bool isKnownConvex(Body *body)
+{
+    if (body->type != SHAPE_POLYGON)
+        return true;
+
+    return body->data.polygon.decomposed && body->data.polygon.convex;
+}
+
+// Where a circle at `center`, the A of `result`, overlaps B most: halfway
+// into the overlap along the normal
+static Vec2 circlePoint(Vec2 center, float radius, CollisionResult *result)
+{
+    return vec_add(center, vec_scale(result->normal, radius - result->depth * 0.5f));
+}
+
+static void setSinglePoint(CollisionResult *result, Vec2 point, uint32_t id)
+{
+    result->points[0] = (ContactPoint){point, result->depth, id};
+    result->pointCount = 1;
+}
+
+bool collideCircles(Body *A, Transform xfA, Body *B, Transform xfB, CollisionResult *result)
+{
+    result->hit = false;
+
+    Vec2 d = vec_sub(xfB.position, xfA.position);
+    float radius = A->data.ellipse.r.x + B->data.ellipse.r.x;
+    float dist2 = vec_dot(d, d);
+
+    if (dist2 >= radius * radius)
+        return false;
+
+    float dist = sqrtf(dist2);
+
+    result->hit = true;
+    result->normal = dist > 1e-8f ? vec_scale(d, 1.0f / dist) : (Vec2){1.0f, 0.0f};
+    result->depth = radius - dist;
+    setSinglePoint(result, circlePoint(xfA.position, A->data.ellipse.r.x, result), 0);
+    return true;
+}
+
+bool collideCirclePolygon(Body *A, Transform xfA, Body *B, Transform xfB, CollisionResult *result)
+{
+    result->hit = false;
+
+    float radius = A->data.ellipse.r.x;
+    Vec2 center = tf_invPoint(xfB, xfA.position);
+    Vec2 *v = B->data.polygon.vertices;
+    Vec2 *n = B->data.polygon.normals;
+    int count = B->data.polygon.numVertices;
+
+    // Face the circle center is furthest in front of
+    int face = 0;
+    float separation = -FLT_MAX;
+    for (int i = 0; i < count; i++)
+    {
+        float s = vec_dot(n[i], vec_sub(center, v[i]));
+        if (s > radius)
+            return false;
+
+        if (s > separation)
+        {
+            separation = s;
+            face = i;
+        }
+    }
+
+    Vec2 v1 = v[face];
+    Vec2 v2 = v[(face + 1) % count];
+
+    // Normal in the polygon's frame, pointing from the polygon to the circle
+    Vec2 localNormal = n[face];
+    float depth = radius - separation;
+
+    if (separation > 1e-8f)
+    {
+        // Center is outside; it may be closest to one of the face's corners
+        Vec2 corner = v1;
+        bool inVertexRegion = true;
+
+        if (vec_dot(vec_sub(center, v1), vec_sub(v2, v1)) <= 0.0f)
+            corner = v1;
+        else if (vec_dot(vec_sub(center, v2), vec_sub(v1, v2)) <= 0.0f)
+            corner = v2;
+        else
+            inVertexRegion = false;
+
+        if (inVertexRegion)
+        {
+            Vec2 d = vec_sub(center, corner);
+            float dist = vec_length(d);
+            if (dist >= radius)
+                return false;
+
+            localNormal = vec_scale(d, 1.0f / dist);
+            depth = radius - dist;
+        }
+    }
+
+    result->hit = true;
+    result->normal = vec_neg(tf_vector(xfB, localNormal));
+    result->depth = depth;
+    setSinglePoint(result, circlePoint(xfA.position, radius, result), face);
+    return true;
+}
+
+bool collideCircleLine(Body *A, Transform xfA, Body *B, Transform xfB, CollisionResult *result)
+{
+    result->hit = false;
+
+    float radius = A->data.ellipse.r.x;
+    Vec2 center = tf_invPoint(xfB, xfA.position);
+    Vec2 p0 = B->data.line.vertices[0];
+    Vec2 p1 = B->data.line.vertices[1];
+    Vec2 e = vec_sub(p1, p0);
+
+    // Closest point on the segment
+    float len2 = vec_dot(e, e);
+    float t = len2 > 1e-12f ? vec_dot(vec_sub(center, p0), e) / len2 : 0.0f;
+    t = fminf(fmaxf(t, 0.0f), 1.0f);
+
+    Vec2 d = vec_sub(center, vec_add(p0, vec_scale(e, t)));
+    float dist2 = vec_dot(d, d);
+
+    if (dist2 >= radius * radius)
+        return false;
+
+    float dist = sqrtf(dist2);
+    Vec2 localNormal = dist > 1e-8f ? vec_scale(d, 1.0f / dist) : vec_normalize((Vec2){e.y, -e.x});
+
+    result->hit = true;
+    result->normal = vec_neg(tf_vector(xfB, localNormal));
+    result->depth = radius - dist;
+    setSinglePoint(result, circlePoint(xfA.position, radius, result), 0);
+    return true;
+}
+
+static ConvexView convexView(Body *body, Transform xf, Vec2 lineNormals[2])
+{
+    if (body->type == SHAPE_LINE)
+    {
+        Vec2 e = vec_sub(body->data.line.vertices[1], body->data.line.vertices[0]);
+        lineNormals[0] = vec_normalize((Vec2){e.y, -e.x});
+        lineNormals[1] = vec_neg(lineNormals[0]);
+
+        return (ConvexView){xf, body->data.line.vertices, lineNormals, 2};
+    }
+
+    return (ConvexView){xf, body->data.polygon.vertices, body->data.polygon.normals, body->data.polygon.numVertices};
+}
+
+// Largest separation of B from any face of A, measured in B's local frame
+static float findMaxSeparation(ConvexView *A, ConvexView *B, int *face)
+{
+    float best = -FLT_MAX;
+    *face = 0;
+
+    for (int i = 0; i < A->count; i++)
+    {
+        Vec2 n = tf_invVector(B->xf, tf_vector(A->xf, A->normals[i]));
+        Vec2 p = tf_invPoint(B->xf, tf_point(A->xf, A->vertices[i]));
+
+        float s = FLT_MAX;
+        for (int j = 0; j < B->count; j++)
+            s = fminf(s, vec_dot(n, vec_sub(B->vertices[j], p)));
+
+        if (s > best)
+        {
+            best = s;
+            *face = i;
+        }
+    }
+
+    return best;
+}
+
+typedef struct
+{
+    Vec2 point;
+    uint32_t id;
+} ClipVertex;
+
+// Feature pair of a contact point: the reference edge, the vertex the point
+// started at (of the incident edge, or of the reference edge when clipping
+// made the point), and whether the reference edge is B's
+static uint32_t featureId(int referenceEdge, int vertex, bool clipped, bool flip)
+{
+    return (uint32_t)referenceEdge << 16 | (uint32_t)(vertex & 0x3fff) << 2 | (uint32_t)clipped << 1 | (uint32_t)flip;
+}
+
+// Keeps what lies on the side of the plane where dot(normal, p) <= offset.
+// A point made on the plane gets `clipId`.
+static int clipSegment(ClipVertex *in, int count, ClipVertex out[2], Vec2 normal, float offset, uint32_t clipId)
+{
+    int kept = 0;
+    float distance[2];
+
+    for (int i = 0; i < count; i++)
+    {
+        distance[i] = vec_dot(normal, in[i].point) - offset;
+        if (distance[i] <= 0.0f)
+            out[kept++] = in[i];
+    }
+
+    if (count == 2 && distance[0] * distance[1] < 0.0f)
+    {
+        float t = distance[0] / (distance[0] - distance[1]);
+        out[kept++] = (ClipVertex){vec_add(in[0].point, vec_scale(vec_sub(in[1].point, in[0].point), t)), clipId};
+    }
+
+    return kept;
+}
+
+// Reference edge clipping. The edge of the incident shape facing most
+// against the reference normal is cut to the side planes of the reference
+// edge; what is left behind the reference edge touches.
+static void clipManifold(ConvexView *ref, int face, ConvexView *inc, bool flip, CollisionResult *result)
+{
+    int next = (face + 1) % ref->count;
+    Vec2 normal = tf_vector(ref->xf, ref->normals[face]);
+    Vec2 r1 = tf_point(ref->xf, ref->vertices[face]);
+    Vec2 r2 = tf_point(ref->xf, ref->vertices[next]);
+
+    int incident = 0;
+    float minDot = FLT_MAX;
+    for (int i = 0; i < inc->count; i++)
+    {
+        float d = vec_dot(tf_vector(inc->xf, inc->normals[i]), normal);
+        if (d < minDot)
+        {
+            minDot = d;
+            incident = i;
+        }
+    }
+
+    int incidentNext = (incident + 1) % inc->count;
+    ClipVertex edge[2] = {
+        {tf_point(inc->xf, inc->vertices[incident]), featureId(face, incident, false, flip)},
+        {tf_point(inc->xf, inc->vertices[incidentNext]), featureId(face, incidentNext, false, flip)}};
+
+    Vec2 tangent = vec_normalize(vec_sub(r2, r1));
+    ClipVertex sideClipped[2], clipped[2];
+    int count = clipSegment(edge, 2, sideClipped, vec_neg(tangent), -vec_dot(tangent, r1), featureId(face, face, true, flip));
+    count = clipSegment(sideClipped, count, clipped, tangent, vec_dot(tangent, r2), featureId(face, next, true, flip));
+
+    float offset = vec_dot(normal, r1);
+    result->pointCount = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        float separation = vec_dot(normal, clipped[i].point) - offset;
+        if (separation > 0.0f)
+            continue;
+
+        // Halfway between the incident point and the reference edge
+        Vec2 point = vec_sub(clipped[i].point, vec_scale(normal, separation * 0.5f));
+        result->points[result->pointCount++] = (ContactPoint){point, -separation, clipped[i].id};
+    }
+
+    // Clipping only comes up empty when the edges are nearly degenerate;
+    // the deeper incident vertex still marks where they touch
+    if (result->pointCount == 0)
+    {
+        ClipVertex deepest = vec_dot(normal, edge[0].point) < vec_dot(normal, edge[1].point) ? edge[0] : edge[1];
+        result->points[0] = (ContactPoint){deepest.point, result->depth, deepest.id};
+        result->pointCount = 1;
+    }
+}
+
+// Separating axis test over the cached edge normals of both shapes, then
+// clipping for up to two contact points
+bool collidePolygons(Body *A, Transform xfA, Body *B, Transform xfB, CollisionResult *result)
+{
+    if (!isKnownConvex(A) || !isKnownConvex(B))
+        return checkCollisionGJK(A, xfA, B, xfB, NULL, result);
+
+    result->hit = false;
+
+    Vec2 lineNormalsA[2], lineNormalsB[2];
+    ConvexView a = convexView(A, xfA, lineNormalsA);
+    ConvexView b = convexView(B, xfB, lineNormalsB);
+
+    int faceA, faceB;
+    float separationA = findMaxSeparation(&a, &b, &faceA);
+    if (separationA >= 0.0f)
+        return false;
+
+    float separationB = findMaxSeparation(&b, &a, &faceB);
+    if (separationB >= 0.0f)
+        return false;
+
+    result->hit = true;
+
+    // B's edge has to be clearly better to take over, so resting contacts
+    // do not flip their reference edge (and feature ids) from step to step
+    if (separationB > separationA + REFERENCE_EDGE_TOLERANCE)
+    {
+        result->normal = vec_neg(tf_vector(xfB, b.normals[faceB]));
+        result->depth = -separationB;
+        clipManifold(&b, faceB, &a, true, result);
+    }
+    else
+    {
+        result->normal = tf_vector(xfA, a.normals[faceA]);
+        result->depth = -separationA;
+        clipManifold(&a, faceA, &b, false, result);
+    }
+
+    return true;
+}
+
+// Polygon and line pairs, with GJK picking up the rare polygon not yet
+// known to be convex so it can use the pair's cache
+static bool collideConvex(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result)
+{
+    if (!isKnownConvex(A) || !isKnownConvex(B))
+        return checkCollisionGJK(A, xfA, B, xfB, cache, result);
+
+    return collidePolygons(A, xfA, B, xfB, result);
+}
+
+static bool collideEllipses(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result)
+{
+    if (isCircle(A) && isCircle(B))
+        return collideCircles(A, xfA, B, xfB, result);
+
+    return checkCollisionGJK(A, xfA, B, xfB, cache, result);
+}
+
+static bool collideEllipsePolygon(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result)
+{
+    if (isCircle(A) && isKnownConvex(B))
+        return collideCirclePolygon(A, xfA, B, xfB, result);
+
+    return checkCollisionGJK(A, xfA, B, xfB, cache, result);
+}
+
+static bool collideEllipseLine(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result)
+{
+    if (isCircle(A))
+        return collideCircleLine(A, xfA, B, xfB, result);
+
+    return checkCollisionGJK(A, xfA, B, xfB, cache, result);
+}
+
+// The swapped kernels see the pair as B, A, and so does the cache while
+// they run
+static void flipCache(GJKCache *cache)
+{
+    if (!cache)
+        return;
+
+    cache->direction = vec_neg(cache->direction);
+    for (int i = 0; i < cache->count; i++)
+        cache->supportDirections[i] = vec_neg(cache->supportDirections[i]);
+}
+
+static bool collidePolygonEllipse(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result)
+{
+    flipCache(cache);
+    bool hit = collideEllipsePolygon(B, xfB, A, xfA, cache, result);
+    flipCache(cache);
+    result->normal = vec_neg(result->normal);
+    return hit;
+}
+
+static bool collideLineEllipse(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result)
+{
+    flipCache(cache);
+    bool hit = collideEllipseLine(B, xfB, A, xfA, cache, result);
+    flipCache(cache);
+    result->normal = vec_neg(result->normal);
+    return hit;
+}
+
+static const NarrowphaseFn dispatch[3][3] = {
+    [SHAPE_LINE][SHAPE_LINE] = checkCollisionGJK,
+    [SHAPE_LINE][SHAPE_POLYGON] = collideConvex,
+    [SHAPE_LINE][SHAPE_ELLIPSE] = collideLineEllipse,
+    [SHAPE_POLYGON][SHAPE_LINE] = collideConvex,
+    [SHAPE_POLYGON][SHAPE_POLYGON] = collideConvex,
+    [SHAPE_POLYGON][SHAPE_ELLIPSE] = collidePolygonEllipse,
+    [SHAPE_ELLIPSE][SHAPE_LINE] = collideEllipseLine,
+    [SHAPE_ELLIPSE][SHAPE_POLYGON] = collideEllipsePolygon,
+    [SHAPE_ELLIPSE][SHAPE_ELLIPSE] = collideEllipses};
+
+bool collisionUsesGJK(Body *A, Body *B)
+{
+    if (A->type == SHAPE_ELLIPSE || B->type == SHAPE_ELLIPSE)
+    {
+        Body *ellipse = A->type == SHAPE_ELLIPSE ? A : B;
+        Body *other = ellipse == A ? B : A;
+        return !isCircle(ellipse) || (other->type == SHAPE_ELLIPSE ? !isCircle(other) : !isKnownConvex(other));
+    }
+
+    if (A->type == SHAPE_LINE && B->type == SHAPE_LINE)
+        return true;
+
+    return !isKnownConvex(A) || !isKnownConvex(B);
+}
+
+bool collisionIsCircles(Body *A, Body *B)
+{
+    return isCircle(A) && isCircle(B);
+}
+
+bool checkCollision(Body *A, Transform xfA, Body *B, Transform xfB, GJKCache *cache, CollisionResult *result)
+{
+    return dispatch[A->type][B->type](A, xfA, B, xfB, cache, result);
+}
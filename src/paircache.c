@@ -0,0 +1,155 @@
+#include "paircache.h"
+#include <stdlib.h>
+
+// The body an entry points at, or NULL when its slot no longer holds it
+// because it was removed (or moved since paircache_follow() last ran)
+static Body *liveBody(Body *body, int id)
+{
+    int i = body->index;
+    if (i < 0 || i >= body_count || bodyAt(i) != body || body->id != id)
+        return NULL;
+
+    return body;
+}
+
+static void pushEvent(PairCache *cache, PairEventType type, int idA, int idB, Body *a, Body *b)
+{
+    if (cache->eventCount == cache->eventCapacity)
+    {
+        cache->eventCapacity = cache->eventCapacity ? cache->eventCapacity * 2 : 64;
+        cache->events = realloc(cache->events, sizeof(PairEvent) * cache->eventCapacity);
+    }
+
+    cache->events[cache->eventCount++] = (PairEvent){type, idA, idB, a, b};
+}
+
+int paircache_touch(PairCache *cache, Body *a, Body *b, int stamp)
+{
+    uint64_t key = pairmap_key(a->id, b->id);
+    int e = pairmap_get(&cache->index, key);
+
+    if (e < 0)
+    {
+        if (cache->count == cache->capacity)
+        {
+            cache->capacity = cache->capacity ? cache->capacity * 2 : 256;
+            cache->entries = realloc(cache->entries, sizeof(PairCacheEntry) * cache->capacity);
+        }
+
+        e = cache->count++;
+        cache->entries[e] = (PairCacheEntry){.idA = a->id, .idB = b->id};
+        pairmap_put(&cache->index, key, e);
+    }
+
+    PairCacheEntry *entry = &cache->entries[e];
+
+    // Everything directional is stored from A towards B; follow the pair if
+    // the broadphase reports it the other way round this time
+    if (entry->idA != a->id)
+    {
+        entry->manifold.normal = vec_neg(entry->manifold.normal);
+        entry->gjk.direction = vec_neg(entry->gjk.direction);
+        for (int i = 0; i < entry->gjk.count; i++)
+            entry->gjk.supportDirections[i] = vec_neg(entry->gjk.supportDirections[i]);
+
+        Vec2 position = entry->positionA;
+        entry->positionA = entry->positionB;
+        entry->positionB = position;
+
+        float rotation = entry->rotationA;
+        entry->rotationA = entry->rotationB;
+        entry->rotationB = rotation;
+    }
+
+    entry->idA = a->id;
+    entry->idB = b->id;
+    entry->a = a;
+    entry->b = b;
+    entry->stamp = stamp;
+
+    entry->wasTouching = entry->touching;
+    entry->touching = false;
+    entry->normalImpulse = 0.0f;
+    return e;
+}
+
+// The body with `id` among the moved ones, else the slot it was in
+static Body *followBody(Body *body, int id, Body **moved, int count)
+{
+    if (liveBody(body, id))
+        return body;
+
+    for (int k = 0; k < count; k++)
+    {
+        if (moved[k]->id == id)
+            return moved[k];
+    }
+
+    return body;
+}
+
+void paircache_follow(PairCache *cache, Body **moved, int count)
+{
+    for (int e = 0; e < cache->count; e++)
+    {
+        PairCacheEntry *entry = &cache->entries[e];
+        entry->a = followBody(entry->a, entry->idA, moved, count);
+        entry->b = followBody(entry->b, entry->idB, moved, count);
+    }
+}
+
+PairCacheEntry *paircache_find(PairCache *cache, Body *a, Body *b)
+{
+    int e = pairmap_get(&cache->index, pairmap_key(a->id, b->id));
+    return e >= 0 ? &cache->entries[e] : NULL;
+}
+
+void paircache_update(PairCache *cache, int stamp)
+{
+    cache->eventCount = 0;
+
+    for (int e = 0; e < cache->count;)
+    {
+        PairCacheEntry *entry = &cache->entries[e];
+
+        if (entry->stamp == stamp)
+        {
+            if (entry->touching)
+                pushEvent(cache, entry->wasTouching ? PAIR_PERSIST : PAIR_BEGIN, entry->idA, entry->idB, entry->a, entry->b);
+            else if (entry->wasTouching)
+                pushEvent(cache, PAIR_END, entry->idA, entry->idB, entry->a, entry->b);
+
+            e++;
+            continue;
+        }
+
+        // The broadphase skips pairs of resting bodies; their entries wait,
+        // still touching, for one of them to wake up
+        Body *a = liveBody(entry->a, entry->idA);
+        Body *b = liveBody(entry->b, entry->idB);
+        if (a && b && !isAwake(a) && !isAwake(b))
+        {
+            e++;
+            continue;
+        }
+
+        if (entry->touching)
+            pushEvent(cache, PAIR_END, entry->idA, entry->idB, a, b);
+
+        // The last entry fills the gap and is looked at next
+        pairmap_remove(&cache->index, pairmap_key(entry->idA, entry->idB));
+        if (e != --cache->count)
+        {
+            *entry = cache->entries[cache->count];
+            pairmap_put(&cache->index, pairmap_key(entry->idA, entry->idB), e);
+        }
+    }
+}
+
+void paircache_free(PairCache *cache)
+{
+    free(cache->entries);
+    free(cache->events);
+    pairmap_free(&cache->index);
+    *cache = (PairCache){0};
+}
@@ -0,0 +1,119 @@
+#include "pairmap.h"
+#include <stdlib.h>
+
+static int home(PairMap *map, uint64_t key)
+{
+    uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+    return (int)((hash ^ hash >> 32) & (uint64_t)(map->capacity - 1));
+}
+
+// Slot holding `key`, or the free slot where it would go
+static int findSlot(PairMap *map, uint64_t key)
+{
+    int mask = map->capacity - 1;
+    int slot = home(map, key);
+
+    while (map->keys[slot] != key && map->keys[slot] != PAIRMAP_EMPTY)
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+static void grow(PairMap *map)
+{
+    uint64_t *keys = map->keys;
+    int *values = map->values;
+    int capacity = map->capacity;
+
+    map->capacity = capacity ? capacity * 2 : 64;
+    map->keys = malloc(sizeof(uint64_t) * map->capacity);
+    map->values = malloc(sizeof(int) * map->capacity);
+
+    for (int i = 0; i < map->capacity; i++)
+        map->keys[i] = PAIRMAP_EMPTY;
+
+    for (int i = 0; i < capacity; i++)
+    {
+        if (keys[i] == PAIRMAP_EMPTY)
+            continue;
+
+        int slot = findSlot(map, keys[i]);
+        map->keys[slot] = keys[i];
+        map->values[slot] = values[i];
+    }
+
+    free(keys);
+    free(values);
+}
+
+int pairmap_get(PairMap *map, uint64_t key)
+{
+    if (map->count == 0)
+        return -1;
+
+    int slot = findSlot(map, key);
+    return map->keys[slot] == key ? map->values[slot] : -1;
+}
+
+void pairmap_put(PairMap *map, uint64_t key, int value)
+{
+    // Kept at most half full so probe runs stay short
+    if ((map->count + 1) * 2 > map->capacity)
+        grow(map);
+
+    int slot = findSlot(map, key);
+    if (map->keys[slot] == PAIRMAP_EMPTY)
+    {
+        map->keys[slot] = key;
+        map->count++;
+    }
+    map->values[slot] = value;
+}
+
+bool pairmap_remove(PairMap *map, uint64_t key)
+{
+    if (map->count == 0)
+        return false;
+
+    int mask = map->capacity - 1;
+    int hole = findSlot(map, key);
+    if (map->keys[hole] != key)
+        return false;
+
+    // Pull later entries of the probe run into the hole unless that would
+    // put them before their home slot
+    int next = hole;
+    for (;;)
+    {
+        next = (next + 1) & mask;
+        if (map->keys[next] == PAIRMAP_EMPTY)
+            break;
+
+        int want = home(map, map->keys[next]);
+        bool stays = hole <= next ? (hole < want && want <= next) : (hole < want || want <= next);
+        if (stays)
+            continue;
+
+        map->keys[hole] = map->keys[next];
+        map->values[hole] = map->values[next];
+        hole = next;
+    }
+
+    map->keys[hole] = PAIRMAP_EMPTY;
+    map->count--;
+    return true;
+}
+
+void pairmap_clear(PairMap *map)
+{
+    for (int i = 0; i < map->capacity; i++)
+        map->keys[i] = PAIRMAP_EMPTY;
+    map->count = 0;
+}
+
+void pairmap_free(PairMap *map)
+{
+    free(map->keys);
+    free(map->values);
+    *map = (PairMap){0};
+}
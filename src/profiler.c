@@ -0,0 +1,126 @@
+#include "profiler.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char *phaseNames[PROFILE_PHASE_COUNT] = {
+    [PROFILE_PREPARE] = "prepare",
+    [PROFILE_BROADPHASE_UPDATE] = "bp update",
+    [PROFILE_BROADPHASE] = "broadphase",
+    [PROFILE_NARROWPHASE] = "narrowphase",
+    [PROFILE_RESPONSE] = "response",
+    [PROFILE_INTEGRATE] = "integrate",
+    [PROFILE_SLEEP] = "sleep",
+    [PROFILE_DRAW] = "draw",
+    [PROFILE_SWAP] = "swap",
+    [PROFILE_FRAME] = "frame"};
+
+// Ring buffer of per-frame times in milliseconds
+static float samples[PROFILE_PHASE_COUNT][PROFILER_WINDOW];
+static int cursor;
+static int frames;
+
+static double started[PROFILE_PHASE_COUNT];
+static double current[PROFILE_PHASE_COUNT];
+static bool used[PROFILE_PHASE_COUNT];
+static double lastFrameEnd;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+void profiler_begin(ProfilePhase phase)
+{
+    started[phase] = now();
+}
+
+void profiler_end(ProfilePhase phase)
+{
+    current[phase] += now() - started[phase];
+    used[phase] = true;
+}
+
+void profiler_frame_end(void)
+{
+    double time = now();
+
+    // The first call only starts the frame clock; whatever ran before it
+    // is warm-up and would skew the window
+    if (lastFrameEnd == 0.0)
+    {
+        lastFrameEnd = time;
+        for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+            current[p] = 0.0;
+        return;
+    }
+
+    current[PROFILE_FRAME] = time - lastFrameEnd;
+    used[PROFILE_FRAME] = true;
+    lastFrameEnd = time;
+
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+    {
+        samples[p][cursor] = (float)current[p];
+        current[p] = 0.0;
+    }
+
+    cursor = (cursor + 1) % PROFILER_WINDOW;
+    if (frames < PROFILER_WINDOW)
+        frames++;
+}
+
+int profiler_frame_count(void)
+{
+    return frames;
+}
+
+static int compareFloats(const void *a, const void *b)
+{
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+ProfileStats profiler_stats(ProfilePhase phase)
+{
+    if (frames == 0)
+        return (ProfileStats){0.0f, 0.0f, 0.0f};
+
+    float sorted[PROFILER_WINDOW];
+    float sum = 0.0f;
+
+    for (int i = 0; i < frames; i++)
+    {
+        sorted[i] = samples[phase][i];
+        sum += sorted[i];
+    }
+
+    qsort(sorted, frames, sizeof(float), compareFloats);
+
+    // Nearest rank: the smallest sample that at least 99% of frames stay under
+    int rank = (frames * 99 + 99) / 100;
+
+    return (ProfileStats){sorted[0], sum / frames, sorted[rank - 1]};
+}
+
+const char *profiler_phase_name(ProfilePhase phase)
+{
+    return phaseNames[phase];
+}
+
+void profiler_print(FILE *out)
+{
+    fprintf(out, "%-12s %9s %9s %9s  (ms over %d frames)\n", "phase", "min", "avg", "p99", frames);
+
+    for (int p = 0; p < PROFILE_PHASE_COUNT; p++)
+    {
+        if (!used[p])
+            continue;
+
+        ProfileStats stats = profiler_stats(p);
+        fprintf(out, "%-12s %9.3f %9.3f %9.3f\n", phaseNames[p], stats.min, stats.avg, stats.p99);
+    }
+}
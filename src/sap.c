@@ -0,0 +1,329 @@
+#include "sap.h"
+#include <stdlib.h>
+
+// More new proxies than this in one update are merged with a full sort, as
+// each one inserted incrementally walks past half the endpoints on average
+#define SAP_INCREMENTAL_INSERTS 8
+
+// Endpoint order: by value, with min endpoints before max endpoints of the
+// same value so touching bounds overlap, as in aabb_overlap()
+static bool after(SapEndpoint a, SapEndpoint b)
+{
+    return a.value > b.value || (a.value == b.value && (a.data & 1) && !(b.data & 1));
+}
+
+static int compareEndpoints(const void *a, const void *b)
+{
+    SapEndpoint x = *(const SapEndpoint *)a;
+    SapEndpoint y = *(const SapEndpoint *)b;
+    return after(x, y) - after(y, x);
+}
+
+// Whether two proxies overlap along one axis, from their endpoints' order
+static bool overlapsOn(SweepAndPrune *sap, int axis, int p, int q)
+{
+    int *position = sap->position[axis];
+    return position[p * 2] < position[q * 2 + 1] && position[q * 2] < position[p * 2 + 1];
+}
+
+static void addPair(SweepAndPrune *sap, int p, int q)
+{
+    if (sap->pairCount == sap->pairCapacity)
+    {
+        sap->pairCapacity = sap->pairCapacity ? sap->pairCapacity * 2 : 256;
+        sap->pairs = realloc(sap->pairs, sizeof(SapPair) * sap->pairCapacity);
+    }
+
+    sap->pairs[sap->pairCount] = p < q ? (SapPair){p, q} : (SapPair){q, p};
+    pairmap_put(&sap->pairIndex, pairmap_key(p, q), sap->pairCount++);
+}
+
+static void removePair(SweepAndPrune *sap, int p, int q)
+{
+    uint64_t key = pairmap_key(p, q);
+    int index = pairmap_get(&sap->pairIndex, key);
+    if (index < 0)
+        return;
+
+    pairmap_remove(&sap->pairIndex, key);
+
+    // The last pair fills the gap
+    int last = --sap->pairCount;
+    if (index != last)
+    {
+        SapPair moved = sap->pairs[last];
+        sap->pairs[index] = moved;
+        pairmap_put(&sap->pairIndex, pairmap_key(moved.a, moved.b), index);
+    }
+}
+
+int sap_create_proxy(SweepAndPrune *sap, int body)
+{
+    int proxy;
+
+    if (sap->freeCount > 0)
+    {
+        proxy = sap->freeProxies[--sap->freeCount];
+    }
+    else
+    {
+        if (sap->proxyIds == sap->proxyCapacity)
+        {
+            sap->proxyCapacity = sap->proxyCapacity ? sap->proxyCapacity * 2 : 64;
+            sap->proxyBody = realloc(sap->proxyBody, sizeof(int) * sap->proxyCapacity);
+            sap->freeProxies = realloc(sap->freeProxies, sizeof(int) * sap->proxyCapacity);
+            sap->deadProxies = realloc(sap->deadProxies, sizeof(int) * sap->proxyCapacity);
+            sap->active = realloc(sap->active, sizeof(int) * sap->proxyCapacity);
+            sap->activeSlot = realloc(sap->activeSlot, sizeof(int) * sap->proxyCapacity);
+
+            for (int axis = 0; axis < 2; axis++)
+                sap->position[axis] = realloc(sap->position[axis], sizeof(int) * 2 * sap->proxyCapacity);
+        }
+        proxy = sap->proxyIds++;
+    }
+
+    if (sap->endpointCount + 2 > sap->endpointCapacity)
+    {
+        sap->endpointCapacity = (sap->endpointCount + 2) * 2;
+        for (int axis = 0; axis < 2; axis++)
+            sap->endpoints[axis] = realloc(sap->endpoints[axis], sizeof(SapEndpoint) * sap->endpointCapacity);
+    }
+
+    // Appended after every other endpoint on both axes, as if the body came
+    // in from far away, which agrees with it having no pairs yet. The next
+    // update fills in the values and sorts them into place.
+    for (int axis = 0; axis < 2; axis++)
+    {
+        sap->endpoints[axis][sap->endpointCount] = (SapEndpoint){0.0f, proxy * 2};
+        sap->endpoints[axis][sap->endpointCount + 1] = (SapEndpoint){0.0f, proxy * 2 + 1};
+        sap->position[axis][proxy * 2] = sap->endpointCount;
+        sap->position[axis][proxy * 2 + 1] = sap->endpointCount + 1;
+    }
+    sap->endpointCount += 2;
+
+    sap->proxyBody[proxy] = body;
+    sap->proxyCount++;
+    sap->newProxies++;
+    return proxy;
+}
+
+void sap_destroy_proxy(SweepAndPrune *sap, int proxy)
+{
+    sap->proxyBody[proxy] = -1;
+    sap->deadProxies[sap->deadCount++] = proxy;
+    sap->proxyCount--;
+}
+
+void sap_set_body(SweepAndPrune *sap, int proxy, int body)
+{
+    sap->proxyBody[proxy] = body;
+}
+
+// Drops the endpoints and pairs of destroyed proxies in one pass each,
+// after which their ids can be handed out again
+static void removeDead(SweepAndPrune *sap)
+{
+    int kept = 0;
+    for (int axis = 0; axis < 2; axis++)
+    {
+        SapEndpoint *endpoints = sap->endpoints[axis];
+        kept = 0;
+
+        for (int k = 0; k < sap->endpointCount; k++)
+        {
+            if (sap->proxyBody[endpoints[k].data >> 1] < 0)
+                continue;
+
+            sap->position[axis][endpoints[k].data] = kept;
+            endpoints[kept++] = endpoints[k];
+        }
+    }
+    sap->endpointCount = kept;
+
+    for (int i = 0; i < sap->pairCount;)
+    {
+        SapPair pair = sap->pairs[i];
+
+        // Removing moves the last pair into slot i
+        if (sap->proxyBody[pair.a] < 0 || sap->proxyBody[pair.b] < 0)
+            removePair(sap, pair.a, pair.b);
+        else
+            i++;
+    }
+
+    for (int d = 0; d < sap->deadCount; d++)
+        sap->freeProxies[sap->freeCount++] = sap->deadProxies[d];
+    sap->deadCount = 0;
+}
+
+// Full sort of both axes, then a sweep along the one the bodies spread
+// widest on that pairs every interval with those still open when it opens
+static void rebuildPairs(SweepAndPrune *sap, int count, AABB *bounds)
+{
+    sap->pairCount = 0;
+    pairmap_clear(&sap->pairIndex);
+
+    if (sap->endpointCount == 0)
+        return;
+
+    double sum[2] = {0.0, 0.0};
+    double sumSquares[2] = {0.0, 0.0};
+    for (int i = 0; i < count; i++)
+    {
+        double x = (bounds[i].min.x + bounds[i].max.x) * 0.5;
+        double y = (bounds[i].min.y + bounds[i].max.y) * 0.5;
+        sum[0] += x;
+        sum[1] += y;
+        sumSquares[0] += x * x;
+        sumSquares[1] += y * y;
+    }
+
+    double variance[2];
+    for (int axis = 0; axis < 2; axis++)
+        variance[axis] = sumSquares[axis] / count - (sum[axis] / count) * (sum[axis] / count);
+    sap->axis = variance[1] > variance[0];
+
+    for (int axis = 0; axis < 2; axis++)
+    {
+        SapEndpoint *endpoints = sap->endpoints[axis];
+        qsort(endpoints, sap->endpointCount, sizeof(SapEndpoint), compareEndpoints);
+
+        for (int k = 0; k < sap->endpointCount; k++)
+            sap->position[axis][endpoints[k].data] = k;
+    }
+
+    SapEndpoint *endpoints = sap->endpoints[sap->axis];
+    int activeCount = 0;
+
+    for (int k = 0; k < sap->endpointCount; k++)
+    {
+        int proxy = endpoints[k].data >> 1;
+
+        if (endpoints[k].data & 1)
+        {
+            int slot = sap->activeSlot[proxy];
+            int last = sap->active[--activeCount];
+            sap->active[slot] = last;
+            sap->activeSlot[last] = slot;
+        }
+        else
+        {
+            for (int a = 0; a < activeCount; a++)
+            {
+                if (overlapsOn(sap, 1 - sap->axis, sap->active[a], proxy))
+                    addPair(sap, sap->active[a], proxy);
+            }
+
+            sap->activeSlot[proxy] = activeCount;
+            sap->active[activeCount++] = proxy;
+        }
+    }
+}
+
+// Insertion sort of one axis from the previous order. A min endpoint moving
+// left past another proxy's max starts an overlap on this axis and a max
+// moving left past a min ends one; the pair changes only if the two overlap
+// on the other axis. Sorting x first checks y in its old order, then y is
+// sorted against the new x order, so the set ends up exact.
+static void insertionSort(SweepAndPrune *sap, int axis)
+{
+    SapEndpoint *endpoints = sap->endpoints[axis];
+    int *position = sap->position[axis];
+
+    for (int j = 1; j < sap->endpointCount; j++)
+    {
+        SapEndpoint moving = endpoints[j];
+        int i = j - 1;
+
+        while (i >= 0 && after(endpoints[i], moving))
+        {
+            SapEndpoint passed = endpoints[i];
+            int p = moving.data >> 1;
+            int q = passed.data >> 1;
+
+            if ((moving.data & 1) != (passed.data & 1) && overlapsOn(sap, 1 - axis, p, q))
+            {
+                if (moving.data & 1)
+                    removePair(sap, p, q);
+                else
+                    addPair(sap, p, q);
+            }
+
+            endpoints[i + 1] = passed;
+            position[passed.data] = i + 1;
+            i--;
+        }
+
+        endpoints[i + 1] = moving;
+        position[moving.data] = i + 1;
+    }
+}
+
+void sap_update(SweepAndPrune *sap, int count, AABB *bounds)
+{
+    if (sap->deadCount > 0)
+        removeDead(sap);
+
+    for (int axis = 0; axis < 2; axis++)
+    {
+        SapEndpoint *endpoints = sap->endpoints[axis];
+
+        for (int k = 0; k < sap->endpointCount; k++)
+        {
+            AABB *box = &bounds[sap->proxyBody[endpoints[k].data >> 1]];
+            Vec2 corner = endpoints[k].data & 1 ? box->max : box->min;
+            endpoints[k].value = axis == 0 ? corner.x : corner.y;
+        }
+    }
+
+    if (!sap->built || sap->newProxies > SAP_INCREMENTAL_INSERTS)
+    {
+        rebuildPairs(sap, count, bounds);
+    }
+    else
+    {
+        insertionSort(sap, 0);
+        insertionSort(sap, 1);
+    }
+
+    sap->newProxies = 0;
+    sap->built = true;
+}
+
+void sap_collect_pairs(SweepAndPrune *sap, PairList *pairs)
+{
+    unsigned char *flags = bodyState.flags;
+
+    pairs->count = 0;
+
+    for (int i = 0; i < sap->pairCount; i++)
+    {
+        int a = sap->proxyBody[sap->pairs[i].a];
+        int b = sap->proxyBody[sap->pairs[i].b];
+
+        if (!BODY_AWAKE(flags[a]) && !BODY_AWAKE(flags[b]))
+            continue;
+
+        if (a < b)
+            pairlist_push(pairs, bodyAt(a), bodyAt(b));
+        else
+            pairlist_push(pairs, bodyAt(b), bodyAt(a));
+    }
+}
+
+void sap_free(SweepAndPrune *sap)
+{
+    for (int axis = 0; axis < 2; axis++)
+    {
+        free(sap->endpoints[axis]);
+        free(sap->position[axis]);
+    }
+    free(sap->proxyBody);
+    free(sap->freeProxies);
+    free(sap->deadProxies);
+    free(sap->pairs);
+    free(sap->active);
+    free(sap->activeSlot);
+    pairmap_free(&sap->pairIndex);
+    *sap = (SweepAndPrune){0};
+}
@@ -65,4 +65,43 @@ Vec2 vec_scale(Vec2 v, float scalar)
 Vec2 vec_add(Vec2 a, Vec2 b)
 {
     return (Vec2){a.x + b.x, a.y + b.y};
+}
+
+bool aabb_overlap(AABB a, AABB b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y;
+}
+
+AABB aabb_union(AABB a, AABB b)
+{
+    return (AABB){
+        {fminf(a.min.x, b.min.x), fminf(a.min.y, b.min.y)},
+        {fmaxf(a.max.x, b.max.x), fmaxf(a.max.y, b.max.y)}};
+}
+
+Vec2 tf_point(Transform xf, Vec2 local)
+{
+    return (Vec2){
+        local.x * xf.cosRotation - local.y * xf.sinRotation + xf.position.x,
+        local.x * xf.sinRotation + local.y * xf.cosRotation + xf.position.y};
+}
+
+Vec2 tf_vector(Transform xf, Vec2 local)
+{
+    return (Vec2){
+        local.x * xf.cosRotation - local.y * xf.sinRotation,
+        local.x * xf.sinRotation + local.y * xf.cosRotation};
+}
+
+Vec2 tf_invPoint(Transform xf, Vec2 world)
+{
+    return tf_invVector(xf, vec_sub(world, xf.position));
+}
+
+Vec2 tf_invVector(Transform xf, Vec2 world)
+{
+    return (Vec2){
+        world.x * xf.cosRotation + world.y * xf.sinRotation,
+        -world.x * xf.sinRotation + world.y * xf.cosRotation};
 }
\ No newline at end of file
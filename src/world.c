@@ -0,0 +1,938 @@
+#include "world.h"
+#include "narrowphase.h"
+#include "kdtree.h"
+#include "aabbtree.h"
+#include "grid.h"
+#include "sap.h"
+#include "broadphase.h"
+#include "paircache.h"
+#include "circlebatch.h"
+#include "jobs.h"
+#include "profiler.h"
+#include <math.h>
+#include <float.h>
+#include <stdlib.h>
+
+#define BODY_GRAIN 256
+#define PAIR_GRAIN 64
+
+typedef struct
+{
+    Body *a;
+    Body *b;
+    CollisionResult result;
+    int entry; // in pairCache
+} Contact;
+
+typedef struct
+{
+    Contact *contacts;
+    int count;
+    int capacity;
+} ContactList;
+
+static WorldConfig config;
+static KDTree kdTree;
+static AABBTree dynamicTree;
+static SpatialGrid grid;
+static SweepAndPrune sap;
+static PairList pairs;
+static PairList contacts;
+
+// Per-pair data kept across steps, and the entry of each of this step's pairs
+static PairCache pairCache;
+static int *pairEntries;
+static int pairEntryCapacity;
+static int stepCount;
+
+// Bodies flagged BODY_MOVED at the start of the step
+static Body **movedBodies;
+static int movedCapacity;
+
+// Bounds of each body for this step, indexed like bodyAt()
+static AABB *bodyBounds;
+static int boundsCapacity;
+
+// Narrowphase output of each chunk of pairs, resolved in chunk order
+static ContactList *chunkContacts;
+static int chunkCapacity;
+
+// Per worker thread, reused by every chunk the worker runs
+static CircleBatch *threadCircles;
+
+// Union-find scratch for island building, indexed like bodyAt()
+static int *islandParent;
+static float *islandSleepTime;
+static int islandCapacity;
+
+WorldConfig world_default_config(void)
+{
+    return (WorldConfig){
+        .bounds = {{-1.0f, -1.0f}, {1.0f, 1.0f}},
+        .gravity = 0.001f,
+        .allowSleep = true,
+        // Kept below gravity * timeToSleep / 2 so a body at the top of its
+        // arc never counts as resting long enough to sleep in mid-air
+        .sleepVelocity = 0.0002f,
+        .timeToSleep = 0.5f,
+        .threadCount = 0,
+        .broadphase = BROADPHASE_DYNAMIC_TREE,
+        .gridCellSize = 0.0f,
+        .circleLanes = 0};
+}
+
+void world_init(WorldConfig worldConfig)
+{
+    config = worldConfig;
+    jobs_init(config.threadCount);
+    circlebatch_select(config.circleLanes);
+    threadCircles = calloc(jobs_thread_count(), sizeof(CircleBatch));
+}
+
+// Returns the impulse applied along the normal, summed over both bodies
+static float handleCollisionResponse(Body *a, Body *b, CollisionResult *result)
+{
+    if (!result->hit)
+        return 0.0f;
+
+    // The collision normal points from a towards b; everything below works
+    // with the direction a has to be pushed in
+    Vec2 normal = vec_neg(result->normal);
+
+    float percent = 1.0f;
+    float slop = 0.001f;
+    float separationBias = 0.01f; // Small bias to prevent kissing
+
+    float correctionDepth = fmaxf(result->depth - slop, 0.0f) * percent + separationBias;
+
+    int ia = a->index;
+    int ib = b->index;
+    bool aDynamic = bodyState.flags[ia] & BODY_DYNAMIC;
+    bool bDynamic = bodyState.flags[ib] & BODY_DYNAMIC;
+
+    float correctionA = 0.001f;
+    float correctionB = 0.001f;
+
+    if (aDynamic && bDynamic)
+    {
+        correctionA = correctionDepth * 0.5f;
+        correctionB = correctionDepth * 0.5f;
+    }
+    else if (aDynamic)
+    {
+        correctionA = correctionDepth;
+    }
+    else if (bDynamic)
+    {
+        correctionB = correctionDepth;
+    }
+
+    float *px = bodyState.positionX;
+    float *py = bodyState.positionY;
+    float *vx = bodyState.velocityX;
+    float *vy = bodyState.velocityY;
+
+    if (aDynamic)
+    {
+        px[ia] += normal.x * correctionA;
+        py[ia] += normal.y * correctionA;
+    }
+
+    if (bDynamic)
+    {
+        px[ib] -= normal.x * correctionB;
+        py[ib] -= normal.y * correctionB;
+    }
+
+    float applied = 0.0f;
+
+    if (aDynamic)
+    {
+        float vn = vx[ia] * normal.x + vy[ia] * normal.y;
+        if (vn < 0)
+        {
+            float impulse = -vn * (1.0f + a->restitution);
+            vx[ia] += normal.x * impulse;
+            vy[ia] += normal.y * impulse;
+            applied += impulse;
+        }
+    }
+
+    if (bDynamic)
+    {
+        float vn = -(vx[ib] * normal.x + vy[ib] * normal.y);
+        if (vn < 0)
+        {
+            float impulse = -vn * (1.0f + b->restitution);
+            vx[ib] -= normal.x * impulse;
+            vy[ib] -= normal.y * impulse;
+            applied += impulse;
+        }
+    }
+
+    return applied;
+}
+
+static void pushContact(ContactList *list, Body *a, Body *b, CollisionResult *result, int entry)
+{
+    if (list->count >= list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->contacts = realloc(list->contacts, sizeof(Contact) * list->capacity);
+    }
+
+    list->contacts[list->count++] = (Contact){a, b, *result, entry};
+}
+
+// Folds the result of one pair of convex parts into the pair's manifold:
+// the deepest part decides the normal, the deepest points are kept, and
+// point ids take in the parts so they stay apart
+static void mergeManifold(CollisionResult *manifold, CollisionResult *part, int partPair)
+{
+    for (int k = 0; k < part->pointCount; k++)
+    {
+        ContactPoint point = part->points[k];
+        point.id ^= (uint32_t)partPair * 0x9E3779B9u;
+
+        if (manifold->pointCount < MAX_MANIFOLD_POINTS)
+        {
+            manifold->points[manifold->pointCount++] = point;
+            continue;
+        }
+
+        int shallowest = manifold->points[0].depth < manifold->points[1].depth ? 0 : 1;
+        if (point.depth > manifold->points[shallowest].depth)
+            manifold->points[shallowest] = point;
+    }
+
+    if (!manifold->hit || part->depth > manifold->depth)
+    {
+        manifold->normal = part->normal;
+        manifold->depth = part->depth;
+    }
+    manifold->hit = true;
+}
+
+// Runs on worker threads: only reads the bodies. Concave polygons are
+// tested piece by piece but make one manifold, so the response pushes the
+// bodies apart once per pair rather than once per touching triangle.
+static void checkShapeCollision(Body *a, Body *b, ContactList *out, int entry)
+{
+    int aCount, bCount;
+    Body *aParts = convexParts(a, &aCount);
+    Body *bParts = convexParts(b, &bCount);
+    Transform xfA = getTransform(a);
+    Transform xfB = getTransform(b);
+
+    // The pair keeps one GJK cache, which only fits a single pair of parts
+    GJKCache *cache = aCount == 1 && bCount == 1 ? &pairCache.entries[entry].gjk : NULL;
+    CollisionResult manifold = {0};
+
+    for (int i = 0; i < aCount; i++)
+    {
+        Transform partA = partTransform(a, xfA, i);
+
+        for (int j = 0; j < bCount; j++)
+        {
+            CollisionResult result;
+            if (checkCollision(&aParts[i], partA, &bParts[j], partTransform(b, xfB, j), cache, &result))
+            {
+                mergeManifold(&manifold, &result, i * bCount + j);
+            }
+        }
+    }
+
+    if (manifold.hit)
+        pushContact(out, a, b, &manifold, entry);
+}
+
+// Filled shapes hold the bodies inside them rather than push them out
+static bool heldInside(Body *a, Body *b)
+{
+    if ((a->type == SHAPE_POLYGON || a->type == SHAPE_ELLIPSE) &&
+        a->filled && isInsideShape(b, a))
+    {
+        return true;
+    }
+
+    return (b->type == SHAPE_POLYGON || b->type == SHAPE_ELLIPSE) &&
+           b->filled && isInsideShape(a, b);
+}
+
+// Whether the shapes were tested, which leaves the pair's GJK cache as of
+// this step when they are a single convex pair each
+static bool checkPair(Body *a, Body *b, ContactList *out, int entry)
+{
+    if (heldInside(a, b))
+        return false;
+
+    checkShapeCollision(a, b, out, entry);
+    return true;
+}
+
+static void prepareBodies(void *context, int begin, int end, int thread)
+{
+    (void)context;
+    (void)thread;
+
+    for (int i = begin; i < end; i++)
+    {
+        updateConvexParts(bodyAt(i));
+        bodyBounds[i] = findBounds(bodyAt(i));
+    }
+}
+
+// Bodies only translate between setRotation() calls, so a pair found
+// apart cannot touch while the two together have moved less than the
+// distance between them since
+static bool stillApart(PairCacheEntry *entry, Body *a, Body *b)
+{
+    if (entry->separation <= 0.0f ||
+        bodyState.rotation[a->index] != entry->rotationA ||
+        bodyState.rotation[b->index] != entry->rotationB)
+    {
+        return false;
+    }
+
+    float moved = vec_length(vec_sub(getPosition(a), entry->positionA)) +
+                  vec_length(vec_sub(getPosition(b), entry->positionB));
+    return moved < entry->separation;
+}
+
+// GJK shows a pair apart with a bound on their distance for free, so the
+// pair can be skipped until the bodies could have closed it. Like the GJK
+// cache, only while both bodies are a single convex shape.
+static bool skippable(Body *a, Body *b)
+{
+    int aCount, bCount;
+    convexParts(a, &aCount);
+    convexParts(b, &bCount);
+    return aCount == 1 && bCount == 1 && collisionUsesGJK(a, b);
+}
+
+static void recordSeparation(PairCacheEntry *entry, Body *a, Body *b)
+{
+    entry->separation = entry->gjk.separation;
+    entry->positionA = getPosition(a);
+    entry->positionB = getPosition(b);
+    entry->rotationA = bodyState.rotation[a->index];
+    entry->rotationB = bodyState.rotation[b->index];
+}
+
+static void collidePairs(void *context, int begin, int end, int thread)
+{
+    (void)context;
+
+    ContactList *out = &chunkContacts[begin / PAIR_GRAIN];
+    out->count = 0;
+
+    // Circle pairs, the bulk of most scenes, are tested all at once up
+    // front; their contacts still go out in pair order below
+    CircleBatch *circles = &threadCircles[thread];
+    circlebatch_clear(circles);
+
+    for (int p = begin; p < end; p++)
+    {
+        Body *a = pairs.pairs[p].a;
+        Body *b = pairs.pairs[p].b;
+
+        if (collisionIsCircles(a, b))
+            circlebatch_push(circles, a, b, p);
+    }
+
+    circlebatch_run(circles);
+    int circle = 0;
+
+    for (int p = begin; p < end; p++)
+    {
+        // Every pair has its own entry, so chunks can write them in parallel
+        PairCacheEntry *entry = &pairCache.entries[pairEntries[p]];
+        Body *a = pairs.pairs[p].a;
+        Body *b = pairs.pairs[p].b;
+
+        if (circle < circles->count && circles->pair[circle] == p)
+        {
+            if (circles->hit[circle])
+            {
+                CollisionResult result;
+                circlebatch_result(circles, circle, &result);
+                pushContact(out, a, b, &result, pairEntries[p]);
+                entry->manifold = result;
+                entry->touching = true;
+                entry->separation = 0.0f;
+            }
+
+            circle++;
+            continue;
+        }
+
+        bool skip = skippable(a, b);
+        if (skip && stillApart(entry, a, b))
+            continue;
+
+        int first = out->count;
+        bool tested = checkPair(a, b, out, pairEntries[p]);
+
+        if (out->count > first)
+        {
+            entry->manifold = out->contacts[first].result;
+            entry->touching = true;
+            entry->separation = 0.0f;
+        }
+        else if (skip && tested)
+        {
+            recordSeparation(entry, a, b);
+        }
+        else
+        {
+            // Not shown apart by GJK this step, e.g. held inside the other
+            entry->separation = 0.0f;
+        }
+    }
+}
+
+// Applies the narrowphase results on the calling thread, in pair order
+static void resolveContacts(int chunks)
+{
+    contacts.count = 0;
+
+    for (int c = 0; c < chunks; c++)
+    {
+        ContactList *list = &chunkContacts[c];
+
+        for (int i = 0; i < list->count; i++)
+        {
+            Contact *contact = &list->contacts[i];
+
+            // Bodies in contact share an island, so a sleeping body touched
+            // by an awake one wakes up
+            world_wake_body(contact->a);
+            world_wake_body(contact->b);
+            pairlist_push(&contacts, contact->a, contact->b);
+
+            pairCache.entries[contact->entry].normalImpulse +=
+                handleCollisionResponse(contact->a, contact->b, &contact->result);
+        }
+    }
+
+    paircache_update(&pairCache, stepCount);
+}
+
+// Bullets stop this far short of what they hit, the response's slop
+#define BULLET_TARGET 0.001f
+#define BULLET_SUBSTEPS 8
+
+// Moves a bullet a sub-step at a time: up to the first body in its path,
+// bouncing off it like handleCollisionResponse() would, then on with what
+// is left of the step. The other bodies hold still where the step found
+// them. Bullets are few, so a scan over the step's bounds finds what each
+// one sweeps past whichever broadphase is in use.
+static void advanceBullet(int i, float dt)
+{
+    float *px = bodyState.positionX;
+    float *py = bodyState.positionY;
+    float *vx = bodyState.velocityX;
+    float *vy = bodyState.velocityY;
+    unsigned char *flags = bodyState.flags;
+    Body *bullet = bodyAt(i);
+
+    vy[i] -= config.gravity * dt;
+
+    float remaining = dt;
+    for (int substep = 0; substep < BULLET_SUBSTEPS && remaining > 0.0f; substep++)
+    {
+        Vec2 translation = {vx[i] * remaining, vy[i] * remaining};
+
+        AABB start = findBounds(bullet);
+        AABB end = {vec_add(start.min, translation), vec_add(start.max, translation)};
+        AABB sweep = aabb_union(start, end);
+
+        TOIResult first = {.t = 1.0f};
+        Body *obstacle = NULL;
+
+        for (int j = 0; j < body_count; j++)
+        {
+            if (j == i || (flags[j] & BODY_BULLET) || !aabb_overlap(sweep, bodyBounds[j]))
+                continue;
+
+            Body *other = bodyAt(j);
+            if (heldInside(bullet, other))
+                continue;
+
+            TOIResult toi;
+            if (bodyTimeOfImpact(bullet, translation, other, BULLET_TARGET, &toi) && toi.t < first.t)
+            {
+                first = toi;
+                obstacle = other;
+            }
+        }
+
+        px[i] += translation.x * first.t;
+        py[i] += translation.y * first.t;
+
+        if (!obstacle)
+            break;
+
+        // The normal points from the bullet towards what it hit
+        float vn = vx[i] * first.normal.x + vy[i] * first.normal.y;
+        if (vn > 0.0f)
+        {
+            float impulse = vn * (1.0f + bullet->restitution);
+            vx[i] -= first.normal.x * impulse;
+            vy[i] -= first.normal.y * impulse;
+        }
+
+        world_wake_body(obstacle);
+        remaining *= 1.0f - first.t;
+    }
+}
+
+static void advanceBullets(float dt)
+{
+    unsigned char *flags = bodyState.flags;
+
+    for (int i = 0; i < body_count; i++)
+    {
+        if (BODY_AWAKE(flags[i]) && (flags[i] & BODY_BULLET))
+            advanceBullet(i, dt);
+    }
+}
+
+// Streams over the hot arrays only; the cold record is read when a body
+// actually hits a wall. Bullets have been moved already and only bounce.
+static void integrate(void *context, int begin, int end, int thread)
+{
+    float dt = *(float *)context;
+    (void)thread;
+
+    float *px = bodyState.positionX;
+    float *py = bodyState.positionY;
+    float *vx = bodyState.velocityX;
+    float *vy = bodyState.velocityY;
+    unsigned char *flags = bodyState.flags;
+
+    for (int i = begin; i < end; i++)
+    {
+        if (!BODY_AWAKE(flags[i]))
+            continue;
+
+        if (!(flags[i] & BODY_BULLET))
+        {
+            vy[i] -= config.gravity * dt;
+
+            px[i] += vx[i] * dt;
+            py[i] += vy[i] * dt;
+        }
+
+        if (!(flags[i] & BODY_BOUNDED))
+            continue;
+
+        // Only translated since the bounds were computed, so their size holds
+        float radiusX = (bodyBounds[i].max.x - bodyBounds[i].min.x) * 0.5f;
+        float radiusY = (bodyBounds[i].max.y - bodyBounds[i].min.y) * 0.5f;
+
+        if (px[i] - radiusX < config.bounds.min.x)
+        {
+            px[i] = config.bounds.min.x + radiusX;
+            vx[i] *= -bodyAt(i)->restitution;
+        }
+        if (px[i] + radiusX > config.bounds.max.x)
+        {
+            px[i] = config.bounds.max.x - radiusX;
+            vx[i] *= -bodyAt(i)->restitution;
+        }
+        if (py[i] - radiusY < config.bounds.min.y)
+        {
+            py[i] = config.bounds.min.y + radiusY;
+            vy[i] *= -bodyAt(i)->restitution;
+        }
+        if (py[i] + radiusY > config.bounds.max.y)
+        {
+            py[i] = config.bounds.max.y - radiusY;
+            vy[i] *= -bodyAt(i)->restitution;
+        }
+    }
+}
+
+static int findIsland(int i)
+{
+    while (islandParent[i] != i)
+    {
+        islandParent[i] = islandParent[islandParent[i]];
+        i = islandParent[i];
+    }
+    return i;
+}
+
+// Groups awake bodies into islands over this frame's contacts and puts an
+// island to sleep once all of its bodies have been slow for timeToSleep
+static void updateSleep(float dt)
+{
+    if (!config.allowSleep)
+        return;
+
+    if (islandCapacity < body_count)
+    {
+        islandCapacity = body_count * 2;
+        islandParent = realloc(islandParent, sizeof(int) * islandCapacity);
+        islandSleepTime = realloc(islandSleepTime, sizeof(float) * islandCapacity);
+    }
+
+    float tolerance2 = config.sleepVelocity * config.sleepVelocity;
+
+    float *vx = bodyState.velocityX;
+    float *vy = bodyState.velocityY;
+    float *sleepTime = bodyState.sleepTime;
+    unsigned char *flags = bodyState.flags;
+
+    for (int i = 0; i < body_count; i++)
+    {
+        islandParent[i] = i;
+        islandSleepTime[i] = FLT_MAX;
+
+        if (!BODY_AWAKE(flags[i]))
+            continue;
+
+        if (vx[i] * vx[i] + vy[i] * vy[i] > tolerance2)
+            sleepTime[i] = 0.0f;
+        else
+            sleepTime[i] += dt;
+    }
+
+    // Static bodies never join islands, otherwise everything resting on the
+    // same ground would have to sleep together
+    for (int c = 0; c < contacts.count; c++)
+    {
+        int a = contacts.pairs[c].a->index;
+        int b = contacts.pairs[c].b->index;
+
+        if (!BODY_AWAKE(flags[a]) || !BODY_AWAKE(flags[b]))
+            continue;
+
+        int rootA = findIsland(a);
+        int rootB = findIsland(b);
+        if (rootA != rootB)
+            islandParent[rootA] = rootB;
+    }
+
+    for (int i = 0; i < body_count; i++)
+    {
+        if (!BODY_AWAKE(flags[i]))
+            continue;
+
+        int root = findIsland(i);
+        islandSleepTime[root] = fminf(islandSleepTime[root], sleepTime[i]);
+    }
+
+    for (int i = 0; i < body_count; i++)
+    {
+        if (!BODY_AWAKE(flags[i]))
+            continue;
+
+        if (islandSleepTime[findIsland(i)] >= config.timeToSleep)
+        {
+            flags[i] |= BODY_SLEEPING;
+            vx[i] = 0.0f;
+            vy[i] = 0.0f;
+        }
+    }
+}
+
+static int queryKDTree(void *structure, AABB box, Body **out, int maxCount, bool *truncated)
+{
+    return kd_query_aabb(structure, box, out, maxCount, truncated);
+}
+
+static int queryDynamicTree(void *structure, AABB box, Body **out, int maxCount, bool *truncated)
+{
+    return aabbtree_query(structure, box, out, maxCount, truncated);
+}
+
+static int queryGrid(void *structure, AABB box, Body **out, int maxCount, bool *truncated)
+{
+    return grid_query(structure, box, out, maxCount, truncated);
+}
+
+// A removed body's leaf stays behind pointing at a slot that now holds
+// another body, or none at all
+static void removeOrphanProxies(void)
+{
+    for (int n = 0; n < dynamicTree.capacity; n++)
+    {
+        AABBTreeNode *node = &dynamicTree.nodes[n];
+        if (node->height != 0)
+            continue;
+
+        int i = node->body->index;
+        if (i >= body_count || bodyState.proxy[i] != n)
+            aabbtree_destroy_proxy(&dynamicTree, n);
+    }
+}
+
+// Gives new bodies a proxy and refits the ones that moved. Static and
+// sleeping bodies are skipped after insertion unless they were moved by
+// hand, and awake bodies are only reinserted once they leave their fat box.
+static void updateDynamicTree(float dt)
+{
+    int *proxy = bodyState.proxy;
+    unsigned char *flags = bodyState.flags;
+    int proxies = 0;
+
+    // removeBody() marks the body it moves into the freed slot; point its
+    // leaf at the new slot before looking for orphans
+    for (int i = 0; i < body_count; i++)
+    {
+        if (proxy[i] < 0)
+            continue;
+
+        proxies++;
+        if (flags[i] & BODY_MOVED)
+            dynamicTree.nodes[proxy[i]].body = bodyAt(i);
+    }
+
+    if (dynamicTree.proxyCount > proxies)
+        removeOrphanProxies();
+
+    for (int i = 0; i < body_count; i++)
+    {
+        if (proxy[i] < 0)
+        {
+            proxy[i] = aabbtree_create_proxy(&dynamicTree, bodyBounds[i], bodyAt(i));
+        }
+        else if (BODY_AWAKE(flags[i]) || (flags[i] & BODY_MOVED))
+        {
+            Vec2 displacement = {bodyState.velocityX[i] * dt, bodyState.velocityY[i] * dt};
+            aabbtree_move_proxy(&dynamicTree, proxy[i], bodyBounds[i], displacement);
+        }
+
+        flags[i] &= ~BODY_MOVED;
+    }
+}
+
+// Same bookkeeping as updateDynamicTree(), except that every proxy is
+// re-sorted anyway, so there is nothing to skip for resting bodies
+static void updateSweepAndPrune(void)
+{
+    int *proxy = bodyState.proxy;
+    unsigned char *flags = bodyState.flags;
+    int proxies = 0;
+
+    for (int i = 0; i < body_count; i++)
+    {
+        if (proxy[i] < 0)
+            continue;
+
+        proxies++;
+        if (flags[i] & BODY_MOVED)
+            sap_set_body(&sap, proxy[i], i);
+    }
+
+    if (sap.proxyCount > proxies)
+    {
+        for (int p = 0; p < sap.proxyIds; p++)
+        {
+            int i = sap.proxyBody[p];
+            if (i >= 0 && (i >= body_count || proxy[i] != p))
+                sap_destroy_proxy(&sap, p);
+        }
+    }
+
+    for (int i = 0; i < body_count; i++)
+    {
+        if (proxy[i] < 0)
+            proxy[i] = sap_create_proxy(&sap, i);
+
+        flags[i] &= ~BODY_MOVED;
+    }
+
+    sap_update(&sap, body_count, bodyBounds);
+}
+
+void world_wake_body(Body *body)
+{
+    int i = body->index;
+
+    if (!(bodyState.flags[i] & BODY_SLEEPING))
+        return;
+
+    bodyState.flags[i] &= ~BODY_SLEEPING;
+    bodyState.sleepTime[i] = 0.0f;
+}
+
+void world_apply_impulse(Body *body, Vec2 impulse)
+{
+    int i = body->index;
+
+    if (!(bodyState.flags[i] & BODY_DYNAMIC))
+        return;
+
+    bodyState.velocityX[i] += impulse.x * bodyState.inverseMass[i];
+    bodyState.velocityY[i] += impulse.y * bodyState.inverseMass[i];
+    world_wake_body(body);
+}
+
+// removeBody() flags the body it moves into the freed slot, as does moving
+// a body by hand. Resting pairs are not reported again by the broadphase,
+// so their cache entries have to follow the body here.
+static void followMovedBodies(void)
+{
+    unsigned char *flags = bodyState.flags;
+    int count = 0;
+
+    for (int i = 0; i < body_count; i++)
+    {
+        if (!(flags[i] & BODY_MOVED))
+            continue;
+
+        if (count == movedCapacity)
+        {
+            movedCapacity = movedCapacity ? movedCapacity * 2 : 64;
+            movedBodies = realloc(movedBodies, sizeof(Body *) * movedCapacity);
+        }
+        movedBodies[count++] = bodyAt(i);
+
+        // Rebuilt broadphases have no use for the flag
+        if (config.broadphase == BROADPHASE_KDTREE || config.broadphase == BROADPHASE_GRID)
+            flags[i] &= ~BODY_MOVED;
+    }
+
+    if (count > 0)
+        paircache_follow(&pairCache, movedBodies, count);
+}
+
+void world_step(float dt)
+{
+    if (boundsCapacity < body_count)
+    {
+        boundsCapacity = body_count * 2;
+        bodyBounds = realloc(bodyBounds, sizeof(AABB) * boundsCapacity);
+    }
+
+    profiler_begin(PROFILE_PREPARE);
+    followMovedBodies();
+    jobs_parallel_for(body_count, BODY_GRAIN, prepareBodies, NULL);
+    profiler_end(PROFILE_PREPARE);
+
+    profiler_begin(PROFILE_BROADPHASE_UPDATE);
+    switch (config.broadphase)
+    {
+    case BROADPHASE_KDTREE:
+        kd_build(&kdTree, body_count, bodyBounds);
+        break;
+    case BROADPHASE_GRID:
+        grid_build(&grid, body_count, bodyBounds, config.gridCellSize);
+        break;
+    case BROADPHASE_SAP:
+        updateSweepAndPrune();
+        break;
+    default:
+        updateDynamicTree(dt);
+        break;
+    }
+    profiler_end(PROFILE_BROADPHASE_UPDATE);
+
+    profiler_begin(PROFILE_BROADPHASE);
+    switch (config.broadphase)
+    {
+    case BROADPHASE_KDTREE:
+        broadphase_collect(queryKDTree, &kdTree, bodyBounds, &pairs);
+        break;
+    case BROADPHASE_GRID:
+        broadphase_collect(queryGrid, &grid, bodyBounds, &pairs);
+        break;
+    case BROADPHASE_SAP:
+        sap_collect_pairs(&sap, &pairs);
+        break;
+    default:
+        broadphase_collect(queryDynamicTree, &dynamicTree, bodyBounds, &pairs);
+        break;
+    }
+
+    if (pairEntryCapacity < pairs.count)
+    {
+        pairEntryCapacity = pairs.count * 2;
+        pairEntries = realloc(pairEntries, sizeof(int) * pairEntryCapacity);
+    }
+
+    stepCount++;
+    for (int p = 0; p < pairs.count; p++)
+        pairEntries[p] = paircache_touch(&pairCache, pairs.pairs[p].a, pairs.pairs[p].b, stepCount);
+    profiler_end(PROFILE_BROADPHASE);
+
+    int chunks = jobs_chunk_count(pairs.count, PAIR_GRAIN);
+    if (chunkCapacity < chunks)
+    {
+        chunkContacts = realloc(chunkContacts, sizeof(ContactList) * chunks);
+        for (int c = chunkCapacity; c < chunks; c++)
+            chunkContacts[c] = (ContactList){0};
+        chunkCapacity = chunks;
+    }
+
+    profiler_begin(PROFILE_NARROWPHASE);
+    jobs_parallel_for(pairs.count, PAIR_GRAIN, collidePairs, NULL);
+    profiler_end(PROFILE_NARROWPHASE);
+
+    profiler_begin(PROFILE_RESPONSE);
+    resolveContacts(chunks);
+    profiler_end(PROFILE_RESPONSE);
+
+    profiler_begin(PROFILE_INTEGRATE);
+    advanceBullets(dt);
+    jobs_parallel_for(body_count, BODY_GRAIN, integrate, &dt);
+    profiler_end(PROFILE_INTEGRATE);
+
+    profiler_begin(PROFILE_SLEEP);
+    updateSleep(dt);
+    profiler_end(PROFILE_SLEEP);
+}
+
+int world_pair_events(const PairEvent **events)
+{
+    *events = pairCache.events;
+    return pairCache.eventCount;
+}
+
+void world_shutdown(void)
+{
+    kd_free(&kdTree);
+    aabbtree_free(&dynamicTree);
+    grid_free(&grid);
+    sap_free(&sap);
+
+    // Bodies may outlive the world; a new one hands out fresh proxies
+    for (int i = 0; i < body_count; i++)
+        bodyState.proxy[i] = -1;
+    pairlist_free(&pairs);
+    pairlist_free(&contacts);
+
+    paircache_free(&pairCache);
+    free(pairEntries);
+    pairEntries = NULL;
+    pairEntryCapacity = 0;
+    free(movedBodies);
+    movedBodies = NULL;
+    movedCapacity = 0;
+
+    free(islandParent);
+    free(islandSleepTime);
+    islandParent = NULL;
+    islandSleepTime = NULL;
+    islandCapacity = 0;
+
+    free(bodyBounds);
+    bodyBounds = NULL;
+    boundsCapacity = 0;
+
+    for (int c = 0; c < chunkCapacity; c++)
+        free(chunkContacts[c].contacts);
+    free(chunkContacts);
+    chunkContacts = NULL;
+    chunkCapacity = 0;
+
+    for (int t = 0; t < jobs_thread_count(); t++)
+        circlebatch_free(&threadCircles[t]);
+    free(threadCircles);
+    threadCircles = NULL;
+
+    jobs_shutdown();
+}